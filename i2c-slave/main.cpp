@@ -70,6 +70,7 @@ namespace utils
 I2CSlave i2c{PB_9, PB_8};
 
 bool is_pause = false;
+modules::tft_debug_console::task_t pause_task{};
 int32_t current_value = 0;
 utils::system_clock::time_point time_previous{};
 constexpr std::array<utils::system_clock::duration, 3> intervals = {16ms, 200ms,
@@ -77,35 +78,41 @@ constexpr std::array<utils::system_clock::duration, 3> intervals = {16ms, 200ms,
 constexpr size_t highspeed_interval_index = 0;
 size_t current_interval_index = 0;
 
+void update_status()
+{
+    TFT_CONSOLE_SET_STATUS(
+        utils::console, 0, "Rate %d ms  #%" PRId32,
+        static_cast<int>(intervals[current_interval_index].count()),
+        current_value);
+}
 void pause()
 {
     is_pause = !is_pause;
     if (is_pause)
-        utils::console.printf("[-] Pause.\n");
+        pause_task = TFT_CONSOLE_BEGIN_TASK(utils::console, "Pause.");
     else
-        utils::console.printf("[D] Pause.\n");
+        utils::console.end_task(pause_task);
 }
 void reset()
 {
     is_pause = false;
     utils::console.clear();
-    utils::console.printf(R"(I2C Debugger
+    TFT_CONSOLE_PRINTF(utils::console, R"(I2C Debugger
 Button 1 - Pause
 Button 2 - Reset
 Button 3 - Rate
 )");
     if (current_interval_index <= highspeed_interval_index)
-        utils::console.printf("[W] No echo.\n");
+        TFT_CONSOLE_PRINTF(utils::console, "[W] No echo.\n");
 }
 void rate()
 {
     current_interval_index++;
     if (current_interval_index >= intervals.size())
         current_interval_index = 0;
-    utils::console.printf("[I] Rate: %d ms.\n",
-                          intervals[current_interval_index].count());
+    update_status();
     if (current_interval_index <= highspeed_interval_index)
-        utils::console.printf("[W] No echo.\n");
+        TFT_CONSOLE_PRINTF(utils::console, "[W] No echo.\n");
 }
 
 int main()
@@ -113,6 +120,8 @@ int main()
     using namespace utils;
 
     // Initialize the console.
+    utils::console.set_status_rows(1);
+    update_status();
     reset();
 
     // Init I2C.
@@ -157,26 +166,25 @@ int main()
                     current_value++;
                     update = true;
                     time_previous = system_clock::now();
+                    update_status();
                 }
 
                 int result;
                 if (update)
                 {
+                    modules::tft_debug_console::task_t task{};
                     if (current_interval_index > highspeed_interval_index)
                     {
-                        utils::console.printf("[-] Write %d.\n", current_value);
+                        task = TFT_CONSOLE_BEGIN_TASK(utils::console,
+                                                      "Write %" PRId32 ".",
+                                                      current_value);
                     }
                     result =
                         i2c.write(reinterpret_cast<const char*>(&current_value),
                                   sizeof(current_value));
                     if (current_interval_index > highspeed_interval_index)
                     {
-                        if (!result)
-                            utils::console.printf("[D] Write %d.\n",
-                                                  current_value);
-                        else
-                            utils::console.printf("[F] Write %d.\n",
-                                                  current_value);
+                        utils::console.end_task(task, !result);
                     }
                 }
                 else
@@ -184,7 +192,9 @@ int main()
                     result =
                         i2c.write(reinterpret_cast<const char*>(&current_value),
                                   sizeof(current_value));
-                    utils::console.printf("[W] Repeated %d.\n", current_value);
+                    TFT_CONSOLE_PRINTF(utils::console,
+                                       "[W] Repeated %" PRId32 ".\n",
+                                       current_value);
                 }
             }
         }
@@ -12,6 +12,9 @@
 #include "tft_auxiliary_pins.hpp"
 #include "tft_debug_console.hpp"
 #include "tft_device.hpp"
+#include "tft_format.hpp"
+#include "tft_log_ring.hpp"
 #include "tft_spi_base.hpp"
 #include "tft_spi_impl_1.hpp"
 #include "tft_spi_impl_2.hpp"
+#include "tft_trace_sink.hpp"
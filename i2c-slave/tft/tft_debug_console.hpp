@@ -14,13 +14,46 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cinttypes>
+#include <cstring>
 #include <deque>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "tft_device.hpp"
+#include "tft_format.hpp"
+#include "tft_log_ring.hpp"
+#include "tft_trace_sink.hpp"
+
+/**
+ * @brief 设为 1 时，所有日志同时以二进制帧从串口输出，
+ * 用 tools/trace_viewer.cpp 在电脑上解码。
+ * @remark 可以在引用该头文件前重新定义以下宏。
+ */
+#ifndef TFT_DEBUG_CONSOLE_TRACE
+#define TFT_DEBUG_CONSOLE_TRACE 0
+#endif
+#ifndef TFT_DEBUG_CONSOLE_TRACE_TX
+#define TFT_DEBUG_CONSOLE_TRACE_TX USBTX
+#endif
+#ifndef TFT_DEBUG_CONSOLE_TRACE_RX
+#define TFT_DEBUG_CONSOLE_TRACE_RX USBRX
+#endif
+#ifndef TFT_DEBUG_CONSOLE_TRACE_BAUD
+#define TFT_DEBUG_CONSOLE_TRACE_BAUD 921600
+#endif
+
+/**
+ * @brief 设为 1 时，像以前一样在持有 mutex_draw 时光栅化和传输整帧，
+ * 用于和 lock_stats() 的默认结果对比。
+ */
+#ifndef TFT_DEBUG_CONSOLE_LOCKED_RENDER
+#define TFT_DEBUG_CONSOLE_LOCKED_RENDER 0
+#endif
 
 namespace modules
 {
@@ -376,6 +409,21 @@ namespace modules
             set_mode(tft_rs_t::data);
             write(vram.data(), cx * cy * sizeof(uint16_t));
         }
+        /**
+         * @brief 只传输 [y_begin, y_end) 这些像素行。vram 按行存储，
+         * 所以这些行在内存中是连续的。
+         */
+        void blt(int y_begin, int y_end)
+        {
+            if (y_begin >= y_end)
+                return;
+            set_region(0, y_begin, cx - 1, y_end - 1);
+            set_mode(tft_rs_t::index);
+            write(0x2C);
+            set_mode(tft_rs_t::data);
+            write(vram[y_begin].data(),
+                  (y_end - y_begin) * cx * sizeof(uint16_t));
+        }
 
     private:
         // 在缓冲区上直接画字符。
@@ -409,6 +457,13 @@ namespace modules
                 }
             }
         }
+        // 用纯色填充 [y_begin, y_end) 这些像素行。
+        void fill_vram(int y_begin, int y_end, uint16_t color)
+        {
+            color = (color << 8) + (color >> 8);
+            for (int y = y_begin; y < y_end; y++)
+                vram[y].fill(color);
+        }
         // 在缓冲区上直接画字符串，不会自动换行。
         void draw_string_vram(std::string_view str, int x, int y,
                               uint16_t text_color, uint16_t bg_color)
@@ -426,174 +481,1172 @@ namespace modules
 
     private:
         rtos::Thread thread_draw;
+        // 保护 console。只在拷贝快照时持有，光栅化和传输时不持有。
         rtos::Mutex mutex_draw;
-        rtos::ConditionVariable cv_draw{mutex_draw};
+        constexpr static uint32_t flag_log = 1;
+        constexpr static auto spinner_period = 125ms;
+        constexpr static auto blink_period = 500ms;
+        constexpr static auto cursor_idle_timeout = 10s; // 之后光标不再闪烁。
+        constexpr static auto min_frame_interval = 40ms; // 最多 25 帧每秒。
+        constexpr static uint32_t frame_budget_percent = 50; // 绘制占用上限。
+        constexpr static auto legacy_frame_interval = 125ms;
+
+    public:
+        struct frame_stats_t
+        {
+            uint32_t rendered;  // 实际绘制的帧数。
+            uint32_t skipped;   // 按固定 125ms 绘制时会多画的帧数。
+            uint32_t coalesced; // 合并到同一帧中的更新次数。
+        };
+
+    private:
+        frame_stats_t frame_counters{};
+
+        /**
+         * @brief 只在有内容变化时绘制：新日志、转圈动画和光标闪烁各自有
+         * 截止时间，线程睡到最早的截止时间。连续的日志被合并，两帧之间
+         * 至少间隔 min_interval，且绘制耗时不超过 frame_budget_percent。
+         */
         void draw_task()
         {
-            int cursor_counter = 0;
+            using clock = rtos::Kernel::Clock;
+            auto now = clock::now();
+            auto last_frame = now;
+            auto last_log = now;
+            auto next_blink = now + blink_period;
+            auto next_spinner = now + spinner_period;
+            clock::duration min_interval = min_frame_interval;
             bool draw_cursor = true;
+            bool log_dirty = true;    // 日志区需要重绘。
+            bool status_dirty = true; // 状态栏有行需要重绘。
+            bool animating = false;
+            snapshot_t snapshot;
+            auto draw_frame = [&] {
+                uint32_t start = us_ticker_read();
+                draw_console(snapshot, draw_cursor);
+                uint32_t cost_us = us_ticker_read() - start;
+                min_interval = std::max<clock::duration>(
+                    min_frame_interval,
+                    std::chrono::milliseconds(
+                        cost_us / 10 / frame_budget_percent));
+                // 绘制可能耗时数十毫秒，按绘制后的时间计算下次等待。
+                now = clock::now();
+            };
             while (true)
             {
-                rtos::ScopedMutexLock lock{mutex_draw};
-                if (cv_draw.wait_for(
-                        125ms, [this]() { return console.has_updated(); }))
+                auto deadline = clock::time_point::max();
+                if (log_dirty || status_dirty)
+                    deadline = last_frame + min_interval;
+                else
                 {
-                    console.clear_update_tag();
-                    cursor_counter = 7;
-                    draw_cursor = true;
+                    if (now - last_log < cursor_idle_timeout || !draw_cursor)
+                        deadline = next_blink;
+                    if (animating)
+                        deadline = std::min(deadline, next_spinner);
                 }
-                else
+                if (deadline == clock::time_point::max())
+                    rtos::ThisThread::flags_wait_any(flag_log);
+                else if (deadline > now)
+                    rtos::ThisThread::flags_wait_any_for(flag_log,
+                                                         deadline - now);
+
+                bool render = false;
                 {
-                    console.update_status();
-                    cursor_counter += 1;
-                    if (cursor_counter >= 8)
+                    rtos::ScopedMutexLock lock{mutex_draw};
+                    uint32_t start = us_ticker_read();
+                    drain_log();
+                    now = clock::now();
+                    if (console.has_updated())
+                    {
+                        console.clear_update_tag();
+                        if (log_dirty)
+                            frame_counters.coalesced++;
+                        log_dirty = true;
+                        draw_cursor = true;
+                        last_log = now;
+                        next_blink = now + blink_period;
+                    }
+                    animating = console.has_running();
+                    if (!animating)
+                        next_spinner = now + spinner_period;
+                    else if (now >= next_spinner)
                     {
-                        draw_cursor = !draw_cursor;
-                        cursor_counter = 4;
+                        console.update_status();
+                        next_spinner = now + spinner_period;
+                        log_dirty = true;
                     }
+                    if (now >= next_blink)
+                    {
+                        next_blink = now + blink_period;
+                        // 空闲时光标停在显示状态，不再产生新帧。
+                        bool idle = now - last_log >= cursor_idle_timeout;
+                        if (!idle || !draw_cursor)
+                        {
+                            draw_cursor = !draw_cursor;
+                            log_dirty = true;
+                        }
+                    }
+                    status_dirty = status.dirty;
+                    render = (log_dirty || status_dirty) &&
+                             now >= last_frame + min_interval;
+                    if (render)
+                    {
+                        take_snapshot(snapshot, log_dirty);
+                        status.dirty = 0;
+                        status_dirty = false;
+                        frame_counters.rendered++;
+                        frame_counters.skipped +=
+                            std::max<int64_t>(
+                                0, (now - last_frame) / legacy_frame_interval -
+                                       1);
+                        last_frame = now;
+                        log_dirty = false;
+                    }
+#if TFT_DEBUG_CONSOLE_LOCKED_RENDER
+                    if (render)
+                        draw_frame();
+                    render = false;
+#endif
+                    lock_hold_time.add(us_ticker_read() - start);
                 }
-                draw_console(draw_cursor);
+                if (render)
+                    draw_frame();
             }
         }
 
     private:
+        /**
+         * 行首标签。插入时解析一次，之后绘制和动画都不再比较字符串。
+         */
+        enum class tag_t : uint8_t
+        {
+            none,
+            info,    // [I]
+            warning, // [W]
+            error,   // [E]
+            running, // [-] [\] [|] [/]
+            done,    // [*]
+            failed,  // [x]
+            finish,  // [D]，结束对应的 [-]。
+            fail,    // [F]，结束对应的 [-]。
+            n_tag,
+        };
+        constexpr static std::array<uint16_t,
+                                    static_cast<size_t>(tag_t::n_tag)>
+            tag_colors{
+                0xFFFF,                                        // none
+                (0 >> 3) + (255 >> 2 << 5) + (0 >> 3 << 11),   // info
+                (0 >> 3) + (255 >> 2 << 5) + (255 >> 3 << 11), // warning
+                (0 >> 3) + (0 >> 2 << 5) + (255 >> 3 << 11),   // error
+                (0 >> 3) + (114 >> 2 << 5) + (230 >> 3 << 11), // running
+                (255 >> 3) + (255 >> 2 << 5) + (0 >> 3 << 11), // done
+                (0 >> 3) + (0 >> 2 << 5) + (255 >> 3 << 11),   // failed
+                0xFFFF,                                        // finish
+                0xFFFF,                                        // fail
+            }; // B G R
+        constexpr static char spinner[] = {'-', '\\', '|', '/'};
+
+        /**
+         * @brief 根据行首的三个字符确定标签。
+         *
+         * @param phase 标签为 running 时，写入转圈动画的相位。
+         */
+        static tag_t tag_of(std::string_view text, uint8_t& phase)
+        {
+            if (text.size() < 3 || text[0] != '[' || text[2] != ']')
+                return tag_t::none;
+            switch (text[1])
+            {
+            case 'I':
+                return tag_t::info;
+            case 'W':
+                return tag_t::warning;
+            case 'E':
+                return tag_t::error;
+            case '*':
+                return tag_t::done;
+            case 'x':
+                return tag_t::failed;
+            case 'D':
+                return tag_t::finish;
+            case 'F':
+                return tag_t::fail;
+            default:
+                for (uint8_t i = 0; i < std::size(spinner); i++)
+                    if (text[1] == spinner[i])
+                    {
+                        phase = i;
+                        return tag_t::running;
+                    }
+                return tag_t::none;
+            }
+        }
+
+        struct line_t
+        {
+            std::string text;
+            uint32_t id{};   // 行号，单调递增，用作任务句柄。
+            uint32_t hash{}; // message() 的哈希，仅对文本匹配的任务有效。
+            tag_t tag{};
+            uint8_t phase{}; // 转圈动画的相位，仅对 running 有效。
+
+            void classify() { tag = tag_of(text, phase); }
+            /**
+             * @brief 修改标签，同时修改行首的字符。
+             */
+            void set_tag(tag_t new_tag)
+            {
+                tag = new_tag;
+                if (tag == tag_t::done)
+                    text[1] = '*';
+                else if (tag == tag_t::failed)
+                    text[1] = 'x';
+            }
+            void step_spinner()
+            {
+                phase = (phase + 1) % std::size(spinner);
+                text[1] = spinner[phase];
+            }
+            std::string_view message() const
+            {
+                return std::string_view(text).substr(3);
+            }
+        };
+
+        /**
+         * 以消息的哈希为键记录未完成的 [-] 行，使 [D] 和 [F] 能以 O(1)
+         * 找到对应的行。开放寻址，线性探测。
+         */
+        struct pending_table
+        {
+            // 2 的幂，且远大于 console_buffer::max_n_line，因此不会填满。
+            static constexpr size_t capacity = 64;
+            struct entry_t
+            {
+                uint32_t hash;
+                uint32_t id; // 0 表示空。
+            };
+            std::array<entry_t, capacity> entries{};
+
+            static uint32_t hash_of(std::string_view message)
+            {
+                uint32_t hash = 2166136261u; // FNV-1a
+                for (char ch : message)
+                {
+                    hash ^= static_cast<uint8_t>(ch);
+                    hash *= 16777619u;
+                }
+                return hash;
+            }
+            void clear() { entries.fill({}); }
+            void insert(uint32_t hash, uint32_t id)
+            {
+                size_t i = hash & (capacity - 1);
+                while (entries[i].id)
+                    i = (i + 1) & (capacity - 1);
+                entries[i] = {hash, id};
+            }
+            /**
+             * @brief 查找哈希相同且满足 pred 的最早插入的行。
+             *
+             * @return uint32_t 行号。0 表示没有找到。
+             */
+            template <typename pred_t>
+            uint32_t find(uint32_t hash, pred_t pred) const
+            {
+                for (size_t i = hash & (capacity - 1); entries[i].id;
+                     i = (i + 1) & (capacity - 1))
+                    if (entries[i].hash == hash && pred(entries[i].id))
+                        return entries[i].id;
+                return 0;
+            }
+            void erase(uint32_t hash, uint32_t id)
+            {
+                size_t i = hash & (capacity - 1);
+                for (; entries[i].id != id; i = (i + 1) & (capacity - 1))
+                    if (!entries[i].id)
+                        return;
+                // 把后面的元素前移，保证探测序列不断开。
+                for (size_t j = (i + 1) & (capacity - 1); entries[j].id;
+                     j = (j + 1) & (capacity - 1))
+                {
+                    size_t home = entries[j].hash & (capacity - 1);
+                    if (((j - home) & (capacity - 1)) >=
+                        ((j - i) & (capacity - 1)))
+                    {
+                        entries[i] = entries[j];
+                        i = j;
+                    }
+                }
+                entries[i] = {};
+            }
+        };
+
         struct console_buffer
         {
             static constexpr size_t max_n_line = n_line * 2;
-            std::deque<std::string> buffer;
+            std::deque<line_t> buffer;
+            pending_table pending;
+            // 任务句柄到行号的映射，直接映射。一个句柄被覆盖时，
+            // 它的行一定已经滚出缓冲区。
+            static constexpr size_t max_n_task = 32;
+            static_assert(max_n_task >= max_n_line);
+            std::array<std::pair<uint32_t, uint32_t>, max_n_task> tasks{};
+            // 本次 drain_log() 中因会滚出缓冲区而跳过的 [-] 行，值为序号。
+            pending_table skipped;
+            uint32_t n_skipped{};
+            uint32_t next_id{1};
             bool updated{};
             console_buffer() { clear(); }
             void clear()
             {
                 buffer.clear();
-                buffer.push_back("");
+                pending.clear();
+                new_line();
             }
-            void print(std::string_view str, bool recursive_print = false)
+            void print(std::string_view str)
             {
                 for (char ch : str)
                 {
                     if (ch == '\r')
                         continue;
                     else if (ch == '\n')
-                        buffer.push_back("");
+                        end_line();
                     else
-                        buffer.back().push_back(ch);
+                        buffer.back().text.push_back(ch);
                 }
-                if (recursive_print)
+                buffer.back().classify();
+                shrink();
+                updated = true;
+            }
+            /**
+             * @brief 以 [-] 开始一行任务。
+             * 任务只通过句柄结束，不参与文本匹配。
+             */
+            void begin_task(uint32_t task, std::string_view message)
+            {
+                if (!buffer.back().text.empty())
+                    new_line();
+                auto& line = buffer.back();
+                line.text = "[-] ";
+                line.text.append(message.substr(0, message.find('\n')));
+                line.classify();
+                tasks[task % max_n_task] = {task, line.id};
+                new_line();
+                shrink();
+                updated = true;
+            }
+            /**
+             * @brief 结束 begin_task() 开始的任务。若该行已经滚出缓冲区，
+             * 则什么都不做。
+             */
+            /**
+             * @brief 登记被跳过的日志中的 [-] 行。之后与它匹配的 [D] 和 [F]
+             * 也不显示，而不是单独成行。
+             */
+            void skip(std::string_view text)
+            {
+                for (size_t end; (end = text.find('\n')) != text.npos;
+                     text.remove_prefix(end + 1))
+                {
+                    uint8_t phase;
+                    std::string_view line = text.substr(0, end);
+                    if (!line.empty() && line.back() == '\r')
+                        line.remove_suffix(1);
+                    // 留出空位，保证查找能结束。
+                    if (tag_of(line, phase) != tag_t::running ||
+                        n_skipped >= pending_table::capacity / 2)
+                        continue;
+                    n_skipped++;
+                    skipped.insert(pending_table::hash_of(line.substr(3)),
+                                   n_skipped);
+                }
+            }
+            void clear_skipped()
+            {
+                skipped.clear();
+                n_skipped = 0;
+            }
+            void end_task(uint32_t task, bool success)
+            {
+                const auto& [key, id] = tasks[task % max_n_task];
+                if (key != task)
                     return;
-                for (auto it = buffer.begin(); it != buffer.end(); it++)
+                if (auto line = find_line(id);
+                    line && line->tag == tag_t::running)
+                {
+                    line->set_tag(success ? tag_t::done : tag_t::failed);
+                    updated = true;
+                }
+            }
+
+        private:
+            line_t* find_line(uint32_t id)
+            {
+                size_t index = id - buffer.front().id;
+                if (index >= buffer.size())
+                    return nullptr;
+                return &buffer[index];
+            }
+            void new_line()
+            {
+                buffer.emplace_back();
+                buffer.back().id = next_id++;
+            }
+            /**
+             * @brief 一行结束时登记或结束任务。
+             * 匹配成功的 [D] 和 [F] 行被复用为下一行，所以行号保持连续。
+             */
+            void end_line()
+            {
+                auto& line = buffer.back();
+                line.classify();
+                if (line.tag == tag_t::running)
                 {
-                    if ((*it).substr(0, 3) == "[D]" ||
-                        (*it).substr(0, 3) == "[F]")
+                    line.hash = pending_table::hash_of(line.message());
+                    pending.insert(line.hash, line.id);
+                }
+                else if (line.tag == tag_t::finish || line.tag == tag_t::fail)
+                {
+                    uint32_t hash = pending_table::hash_of(line.message());
+                    uint32_t id = pending.find(hash, [&](uint32_t id) {
+                        auto task = find_line(id);
+                        return task && task->message() == line.message();
+                    });
+                    if (id)
                     {
-                        bool flag = false;
-                        for (auto& line_to_modify : buffer)
-                        {
-                            if (line_to_modify.substr(0, 3) == "[-]" ||
-                                line_to_modify.substr(0, 3) == "[\\]" ||
-                                line_to_modify.substr(0, 3) == "[|]" ||
-                                line_to_modify.substr(0, 3) == "[/]")
-                            {
-                                if ((*it).substr(3) != line_to_modify.substr(3))
-                                    continue;
-
-                                if ((*it).substr(0, 3) == "[D]")
-                                    line_to_modify[1] = '*';
-                                else // Fail
-                                    line_to_modify[1] = 'x';
-                                flag = true;
-                                break;
-                            }
-                        }
-                        if (flag)
-                            it = buffer.erase(it);
-                        else
-                        {
-                            // print("[E] No matched task.\n", true);
-                        }
+                        pending.erase(hash, id);
+                        find_line(id)->set_tag(line.tag == tag_t::finish
+                                                   ? tag_t::done
+                                                   : tag_t::failed);
+                        line.text.clear();
+                        line.tag = tag_t::none;
+                        return;
+                    }
+                    // 对应的 [-] 被跳过了，它也不显示。
+                    if (uint32_t skipped_id =
+                            skipped.find(hash, [](uint32_t) { return true; }))
+                    {
+                        skipped.erase(hash, skipped_id);
+                        line.text.clear();
+                        line.tag = tag_t::none;
+                        return;
                     }
+                    // No matched task.
                 }
+                new_line();
+            }
+            void shrink()
+            {
                 while (buffer.size() > max_n_line)
+                {
+                    auto& line = buffer.front();
+                    if (line.tag == tag_t::running)
+                        pending.erase(line.hash, line.id);
                     buffer.pop_front();
-                updated = true;
+                }
             }
+
+        public:
             bool has_updated() const { return updated; }
+            bool has_running() const
+            {
+                return std::any_of(buffer.begin(), buffer.end(),
+                                   [](const line_t& line) {
+                                       return line.tag == tag_t::running;
+                                   });
+            }
             void clear_update_tag() { updated = false; }
             void update_status()
             {
                 for (auto& line : buffer)
-                {
-                    if (line.substr(0, 3) == "[-]")
-                        line[1] = '\\';
-                    else if (line.substr(0, 3) == "[\\]")
-                        line[1] = '|';
-                    else if (line.substr(0, 3) == "[|]")
-                        line[1] = '/';
-                    else if (line.substr(0, 3) == "[/]")
-                        line[1] = '-';
-                }
+                    if (line.tag == tag_t::running)
+                        line.step_spinner();
             }
         } console;
-        void draw_console(bool draw_cursor)
-        {
-            for (auto& line : vram)
-                line.fill(0);
-            int y =
-                -cy_char *
-                std::max(0, static_cast<int>(console.buffer.size()) - n_line);
-            for (const auto& line : console.buffer)
-            {
-                uint16_t color = 0xFFFF;
-                if (line.substr(0, 3) == "[I]")
-                    color =
-                        (0 >> 3) + (255 >> 2 << 5) + (0 >> 3 << 11); // B G R
-                else if (line.substr(0, 3) == "[W]")
-                    color =
-                        (0 >> 3) + (255 >> 2 << 5) + (255 >> 3 << 11); // B G R
-                else if (line.substr(0, 3) == "[E]" ||
-                         line.substr(0, 3) == "[x]")
-                    color =
-                        (0 >> 3) + (0 >> 2 << 5) + (255 >> 3 << 11); // B G R
-                else if (line.substr(0, 3) == "[-]" ||
-                         line.substr(0, 3) == "[\\]" ||
-                         line.substr(0, 3) == "[|]" ||
-                         line.substr(0, 3) == "[/]")
-                    color =
-                        (0 >> 3) + (114 >> 2 << 5) + (230 >> 3 << 11); // B G R
-                else if (line.substr(0, 3) == "[*]")
-                    color =
-                        (255 >> 3) + (255 >> 2 << 5) + (0 >> 3 << 11); // B G R
-                draw_string_vram(line, 0, y, color, 0x0000);
+        /**
+         * 屏幕上的一行，定长存储，拷贝时不分配内存。
+         */
+        struct row_t
+        {
+            char text[n_char_per_line];
+            uint8_t length;
+            tag_t tag;
+
+            bool operator==(const row_t& rhs) const
+            {
+                return length == rhs.length && tag == rhs.tag &&
+                       !std::memcmp(text, rhs.text, length);
+            }
+        };
+
+    public:
+        constexpr static int max_n_status_row = 4;
+
+    private:
+        // 状态栏的背景色。
+        constexpr static uint16_t status_bg_color =
+            (64 >> 3) + (32 >> 2 << 5) + (32 >> 3 << 11); // B G R
+
+        /**
+         * 屏幕顶部的状态栏。每行原地更新，不滚动，也不影响日志。
+         */
+        struct status_pane
+        {
+            std::array<row_t, max_n_status_row> rows{};
+            int n_row{};
+            uint32_t dirty{}; // 需要重绘的行，按位表示。
+
+            void resize(int n)
+            {
+                n_row = std::clamp(n, 0, max_n_status_row);
+                for (int i = n_row; i < max_n_status_row; i++)
+                    rows[i] = {};
+                dirty = (uint32_t(1) << n_row) - 1;
+            }
+            /**
+             * @brief 设置一行的内容。内容不变时不标记重绘。
+             */
+            void set(int index, std::string_view text)
+            {
+                if (index < 0 || index >= n_row)
+                    return;
+                text = text.substr(0, text.find('\n'));
+                row_t row{};
+                row.length = std::min<size_t>(text.size(), n_char_per_line);
+                std::memcpy(row.text, text.data(), row.length);
+                uint8_t phase{};
+                row.tag = tag_of(text, phase);
+                if (row == rows[index])
+                    return;
+                rows[index] = row;
+                dirty |= uint32_t(1) << index;
+            }
+        } status;
+
+        /**
+         * 绘制所需的最小状态，即屏幕上能看到的行。
+         */
+        struct snapshot_t
+        {
+            std::array<row_t, max_n_status_row> status_rows;
+            int n_status_row;
+            uint32_t status_dirty; // 需要重绘的状态栏行。
+            bool log_dirty;        // 是否需要重绘日志区。
+            std::array<row_t, n_line> rows;
+            int n_row;
+            int cursor_x; // 最后一行的长度，以字符为单位。
+        };
+        void take_snapshot(snapshot_t& snapshot, bool log_dirty) const
+        {
+            snapshot.n_status_row = status.n_row;
+            snapshot.status_dirty = status.dirty;
+            for (int i = 0; i < status.n_row; i++)
+                if (status.dirty >> i & 1)
+                    snapshot.status_rows[i] = status.rows[i];
+
+            snapshot.log_dirty = log_dirty;
+            if (!log_dirty)
+                return;
+            const auto& buffer = console.buffer;
+            size_t n_log_line = n_line - status.n_row;
+            size_t first = buffer.size() - std::min<size_t>(buffer.size(),
+                                                            n_log_line);
+            snapshot.n_row = buffer.size() - first;
+            for (size_t i = first; i < buffer.size(); i++)
+            {
+                auto& row = snapshot.rows[i - first];
+                row.length = std::min<size_t>(buffer[i].text.size(),
+                                              n_char_per_line);
+                std::memcpy(row.text, buffer[i].text.data(), row.length);
+                row.tag = buffer[i].tag;
+            }
+            snapshot.cursor_x = buffer.back().text.size();
+        }
+        /**
+         * @brief 只重绘并传输有变化的区域：状态栏逐行，日志区整体。
+         */
+        void draw_console(const snapshot_t& snapshot, bool draw_cursor)
+        {
+            for (int i = 0; i < snapshot.n_status_row; i++)
+            {
+                if (!(snapshot.status_dirty >> i & 1))
+                    continue;
+                const auto& row = snapshot.status_rows[i];
+                int y = i * cy_char;
+                fill_vram(y, y + cy_char, status_bg_color);
+                draw_string_vram(std::string_view(row.text, row.length), 0, y,
+                                 tag_colors[static_cast<size_t>(row.tag)],
+                                 status_bg_color);
+                blt(y, y + cy_char);
+            }
+            if (!snapshot.log_dirty)
+                return;
+
+            int y_log = snapshot.n_status_row * cy_char;
+            fill_vram(y_log, cy, 0x0000);
+            int y = y_log;
+            for (int i = 0; i < snapshot.n_row; i++)
+            {
+                const auto& row = snapshot.rows[i];
+                draw_string_vram(std::string_view(row.text, row.length), 0, y,
+                                 tag_colors[static_cast<size_t>(row.tag)],
+                                 0x0000);
                 y += cy_char;
             }
             y -= cy_char;
             if (draw_cursor)
             {
-                draw_char_vram('_', console.buffer.back().size() * cx_char, y,
-                               0xFFFF, 0x0000);
+                draw_char_vram('_', snapshot.cursor_x * cx_char, y, 0xFFFF,
+                               0x0000);
             }
-            blt();
+            blt(y_log, cy);
         }
 
-    public:
+    private:
+        /**
+         * 以 2 的幂（微秒）为桶统计 mutex_draw 的持有时间。
+         */
+        struct hold_time_histogram
+        {
+            constexpr static size_t n_bucket = 20;
+            std::array<uint32_t, n_bucket> buckets{}; // [2^(i-1), 2^i) us
+            uint32_t count{};
+            uint32_t max{};
+            void add(uint32_t us)
+            {
+                size_t i = 0;
+                while (i + 1 < n_bucket && (us >> i))
+                    i++;
+                buckets[i]++;
+                count++;
+                max = std::max(max, us);
+            }
+            /**
+             * @return uint32_t 第 percent 百分位数的上界，单位为微秒。
+             */
+            uint32_t percentile(uint32_t percent) const
+            {
+                uint64_t threshold = (uint64_t(count) * percent + 99) / 100;
+                uint64_t n = 0;
+                for (size_t i = 0; i < n_bucket; i++)
+                {
+                    n += buckets[i];
+                    if (n && n >= threshold)
+                        return std::min(max, (uint32_t(1) << i) - 1);
+                }
+                return max;
+            }
+        } lock_hold_time;
+
+    private:
+        constexpr static size_t log_capacity = 32;
+        constexpr static size_t max_args_size = 24;
+        constexpr static size_t max_text_length = 256;
+        // "00: 01 02 03 04 05 06" 恰好占满一行。
+        constexpr static size_t hex_dump_bytes_per_line =
+            (n_char_per_line - tft_format::hex_dump_line_length(0)) / 3;
+        static_assert((hex_dump_bytes_per_line + max_args_size - 1) /
+                              hex_dump_bytes_per_line *
+                              (tft_format::hex_dump_line_length(
+                                   hex_dump_bytes_per_line) +
+                               1) <
+                          max_text_length,
+                      "max_text_length is too small for a hex dump record.");
+
+        /**
+         * @brief 按默认实参提升后的类型传参，与 printf 实际收到的一致，
+         * 这样解码时只需要格式字符串。
+         */
+        template <typename T>
+        static auto promote(T value)
+        {
+            if constexpr (std::is_floating_point<T>::value)
+                return static_cast<double>(value);
+            else if constexpr (std::is_enum<T>::value)
+                return +static_cast<std::underlying_type_t<T>>(value);
+            else if constexpr (std::is_pointer<T>::value)
+                return value;
+            else
+                return +value;
+        }
+        /**
+         * @brief 按参数类型原样打包参数，并在绘制线程中解包、格式化。
+         */
         template <typename... R>
-        void printf(const char* format, R&&... args)
+        struct arg_pack
         {
-            char buf[256];
+            static_assert(((std::is_arithmetic<R>::value ||
+                            std::is_enum<R>::value ||
+                            std::is_pointer<R>::value) &&
+                           ...),
+                          "Only arithmetic, enum and pointer arguments can be "
+                          "logged.");
+            static_assert((!std::is_same<R, char*>::value && ...),
+                          "Arguments are formatted later. Do not pass "
+                          "writable (probably temporary) strings.");
+            constexpr static std::array<size_t, sizeof...(R) + 1> offsets()
+            {
+                std::array<size_t, sizeof...(R) + 1> ret{};
+                size_t sizes[] = {sizeof(R)..., 0};
+                for (size_t i = 0; i < sizeof...(R); i++)
+                    ret[i + 1] = ret[i] + sizes[i];
+                return ret;
+            }
+            constexpr static size_t size = offsets()[sizeof...(R)];
+            static_assert(size <= max_args_size, "Too many arguments.");
+
+            static void pack([[maybe_unused]] uint8_t* out, const R&... args)
+            {
+                size_t i = 0;
+                (std::memcpy(out + offsets()[i++], &args, sizeof(R)), ...);
+            }
+            template <typename T>
+            static T unpack(const uint8_t* in)
+            {
+                T value;
+                std::memcpy(&value, in, sizeof(T));
+                return value;
+            }
+            template <size_t... I>
+            static int _format(char* buf, size_t size, const char* format,
+                               [[maybe_unused]] const uint8_t* in,
+                               std::index_sequence<I...>)
+            {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wformat-security"
-            sprintf(buf, format, std::forward<R>(args)...);
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+                return snprintf(buf, size, format,
+                                unpack<R>(in + offsets()[I])...);
 #pragma GCC diagnostic pop
-            rtos::ScopedMutexLock lock(mutex_draw);
-            console.print(buf);
-            cv_draw.notify_one();
+            }
+            static int format(char* buf, size_t size, const char* format,
+                              const uint8_t* in)
+            {
+                return _format(buf, size, format, in,
+                               std::index_sequence_for<R...>{});
+            }
+        };
+
+        /**
+         * @brief 一条日志只保存格式字符串的地址和打包的参数，
+         * 只有会显示出来的日志才会被格式化。
+         */
+        struct log_record
+        {
+            enum class kind_t : uint8_t
+            {
+                print,
+                clear,
+                begin_task,
+                end_task,
+                set_status, // task 为行号。
+                set_layout, // task 为状态栏的行数。
+                hex_dump,   // args 为原始数据，task 为第一个字节的偏移。
+            } kind;
+            bool success;
+            uint8_t args_size;
+            uint32_t timestamp_us;
+            uint32_t task;
+            const char* format;
+            int (*formatter)(char*, size_t, const char*, const uint8_t*);
+            alignas(8) uint8_t args[max_args_size];
+
+            /**
+             * @brief 该日志至少在缓冲区中新增的行数。
+             * 以 [D] 或 [F] 开头的行可能结束对应的 [-] 而不占新行，
+             * 以参数开头的行也可能如此，所以都不计入。
+             */
+            size_t n_line() const
+            {
+                if (kind == kind_t::hex_dump)
+                    return (args_size + hex_dump_bytes_per_line - 1) /
+                           hex_dump_bytes_per_line;
+                if (kind != kind_t::print)
+                    return kind == kind_t::begin_task;
+                size_t n = 0;
+                const char* line = format;
+                for (const char* p = format; *p; p++)
+                    if (*p == '\n')
+                    {
+                        n += !may_finish_task(line);
+                        line = p + 1;
+                    }
+                return n;
+            }
+            static bool may_finish_task(const char* line)
+            {
+                return line[0] == '%' ||
+                       (line[0] == '[' &&
+                        (line[1] == 'D' || line[1] == 'F' || line[1] == '%'));
+            }
+            /**
+             * @brief 是否可能含有 [-] 行。只看格式串中的行首。
+             */
+            bool may_begin_task() const
+            {
+                if (kind != kind_t::print)
+                    return false;
+                for (const char* line = format; *line;)
+                {
+                    if (line[0] == '%' ||
+                        (line[0] == '[' &&
+                         (line[1] == '%' ||
+                          std::find(std::begin(spinner), std::end(spinner),
+                                    line[1]) != std::end(spinner))))
+                        return true;
+                    const char* end = std::strchr(line, '\n');
+                    if (!end)
+                        break;
+                    line = end + 1;
+                }
+                return false;
+            }
+        };
+        mpsc_ring<log_record, log_capacity> log;
+        std::atomic<uint32_t> next_task{1};
+        uint32_t n_dropped_shown{};
+
+        template <typename fill_t>
+        void post(fill_t&& fill)
+        {
+            if (log.push([&](log_record& record) {
+                    record.timestamp_us = us_ticker_read();
+                    fill(record);
+                }))
+                thread_draw.flags_set(flag_log); // 可以在中断中调用。
+        }
+        template <typename... R>
+        static void pack(log_record& record, const char* format,
+                         R&&... args)
+        {
+            using pack_t =
+                arg_pack<decltype(promote(std::declval<std::decay_t<R>>()))...>;
+            record.format = format;
+            record.formatter = &pack_t::format;
+            record.args_size = pack_t::size;
+            pack_t::pack(record.args, promote<std::decay_t<R>>(args)...);
+        }
+#if TFT_DEBUG_CONSOLE_TRACE
+        tft_trace_sink<> trace{TFT_DEBUG_CONSOLE_TRACE_TX,
+                               TFT_DEBUG_CONSOLE_TRACE_RX,
+                               TFT_DEBUG_CONSOLE_TRACE_BAUD};
+        void trace_record(const log_record& record)
+        {
+            uint8_t frame[sizeof(trace_frame_header) + max_args_size + 1];
+            trace_frame_header header{
+                trace_frame_header::sync_byte,
+                record.args_size,
+                static_cast<uint8_t>(record.kind),
+                static_cast<uint8_t>(record.success),
+                record.timestamp_us,
+                record.task,
+                static_cast<uint32_t>(
+                    reinterpret_cast<uintptr_t>(record.format)),
+            };
+            std::memcpy(frame, &header, sizeof(header));
+            std::memcpy(frame + sizeof(header), record.args, record.args_size);
+            size_t size = sizeof(header) + record.args_size;
+            uint8_t checksum = 0;
+            for (size_t i = 0; i < size; i++)
+                checksum ^= frame[i];
+            frame[size++] = checksum;
+            trace.write(frame, size);
+        }
+#endif
+        /**
+         * @brief 把 hex_dump 记录格式化为若干行，每行以换行结尾。
+         */
+        static void format_hex_dump(char* first, char* last,
+                                    const log_record& record)
+        {
+            for (size_t i = 0; i < record.args_size;
+                 i += hex_dump_bytes_per_line)
+            {
+                size_t size = std::min<size_t>(hex_dump_bytes_per_line,
+                                               record.args_size - i);
+                first = tft_format::hex_dump_line(first, last,
+                                                  record.task + i,
+                                                  record.args + i, size)
+                            .ptr;
+                *first++ = '\n';
+            }
+            *first = '\0';
+        }
+        /**
+         * @brief 由绘制线程把队列中的日志写入 console。
+         * 会滚出缓冲区的日志不会被格式化，可能开始任务的除外。
+         */
+        void drain_log()
+        {
+            size_t n_record = log.readable();
+#if TFT_DEBUG_CONSOLE_TRACE
+            for (size_t i = 0; i < n_record; i++)
+                trace_record(log.peek(i));
+#endif
+            console.clear_skipped();
+            size_t first = n_record;
+            for (size_t n_line = 0; first && n_line <= console.max_n_line;)
+            {
+                const auto& record = log.peek(--first);
+                if (record.kind == log_record::kind_t::clear)
+                    break;
+                n_line += record.n_line();
+            }
+            for (size_t i = 0; i < n_record; i++)
+            {
+                const auto& record = log.peek(i);
+                char text[max_text_length];
+                // 状态栏不受滚动影响，所以总是要处理。
+                if (i < first &&
+                    record.kind != log_record::kind_t::set_status &&
+                    record.kind != log_record::kind_t::set_layout)
+                {
+                    // 只格式化可能开始任务的日志，使之后的 [D] 和 [F]
+                    // 不单独成行。
+                    if (record.may_begin_task())
+                    {
+                        record.formatter(text, sizeof(text), record.format,
+                                         record.args);
+                        console.skip(text);
+                    }
+                    continue;
+                }
+                if (record.formatter)
+                    record.formatter(text, sizeof(text), record.format,
+                                     record.args);
+                else if (record.kind == log_record::kind_t::hex_dump)
+                    format_hex_dump(text, std::end(text), record);
+                switch (record.kind)
+                {
+                case log_record::kind_t::print:
+                    console.print(text);
+                    break;
+                case log_record::kind_t::clear:
+                    console.clear();
+                    break;
+                case log_record::kind_t::begin_task:
+                    console.begin_task(record.task, text);
+                    break;
+                case log_record::kind_t::end_task:
+                    console.end_task(record.task, record.success);
+                    break;
+                case log_record::kind_t::set_status:
+                    status.set(record.task, text);
+                    break;
+                case log_record::kind_t::set_layout:
+                    status.resize(record.task);
+                    console.updated = true; // 日志区的位置变了。
+                    break;
+                case log_record::kind_t::hex_dump:
+                    if (!console.buffer.back().text.empty())
+                        console.print("\n");
+                    console.print(text);
+                    break;
+                }
+            }
+            log.release(n_record);
+
+            if (uint32_t n_dropped = log.dropped();
+                n_dropped != n_dropped_shown)
+            {
+                char buf[32] = "[E] Dropped ";
+                char* p = buf + std::strlen(buf);
+                p = tft_format::to_chars_dec(p, std::end(buf) - 3,
+                                             n_dropped - n_dropped_shown)
+                        .ptr;
+                std::strcpy(p, ".\n");
+                console.print(buf);
+                n_dropped_shown = n_dropped;
+            }
+        }
+
+    public:
+        /**
+         * @brief 输出日志。不会阻塞，可以在中断中调用。
+         * 队列满时丢弃该条日志，见 dropped_records()。
+         * @remark 只保存 format 的地址和参数的值，格式化在绘制线程中进行，
+         * 所以 format 和 %s 对应的字符串必须一直有效（如字符串字面量）。
+         * 使用 TFT_CONSOLE_PRINTF 可以在编译时检查格式。
+         */
+        template <typename... R>
+        void printf(const char* format, R&&... args)
+        {
+            post([&](log_record& record) {
+                record.kind = log_record::kind_t::print;
+                record.task = 0;
+                record.success = false;
+                pack(record, format, args...);
+            });
+        }
+
+        /**
+         * @brief 任务句柄。0 表示无效。
+         */
+        using task_t = uint32_t;
+        /**
+         * @brief 显示一行 [-] 任务，用返回的句柄调用 end_task() 结束它。
+         * 与 printf("[-] ...") 不同，结束时不依赖文本相同。
+         * @remark 对 format 和参数的要求同 printf()。
+         */
+        template <typename... R>
+        task_t begin_task(const char* format, R&&... args)
+        {
+            task_t task = next_task.fetch_add(1, std::memory_order_relaxed);
+            post([&](log_record& record) {
+                record.kind = log_record::kind_t::begin_task;
+                record.task = task;
+                record.success = false;
+                pack(record, format, args...);
+            });
+            return task;
+        }
+        /**
+         * @brief 结束任务，成功显示为 [*]，失败显示为 [x]。
+         */
+        void end_task(task_t task, bool success = true)
+        {
+            post([&](log_record& record) {
+                record.kind = log_record::kind_t::end_task;
+                record.task = task;
+                record.success = success;
+                record.format = nullptr;
+                record.formatter = nullptr;
+                record.args_size = 0;
+            });
         }
 
         void clear()
+        {
+            post([](log_record& record) {
+                record.kind = log_record::kind_t::clear;
+                record.task = 0;
+                record.success = false;
+                record.format = nullptr;
+                record.formatter = nullptr;
+                record.args_size = 0;
+            });
+        }
+
+        /**
+         * @brief 以十六进制显示一段数据，如 "08: 01 A2 FF"，每行 6 个字节。
+         * 不会阻塞，可以在中断中调用。
+         * @remark 数据在调用时就被拷贝，所以可以是临时缓冲区。每条记录
+         * 最多保存 24 字节，更长的数据占用多条记录。
+         */
+        void hex_dump(const void* data, size_t size)
+        {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            for (size_t offset = 0; offset < size; offset += max_args_size)
+            {
+                post([&](log_record& record) {
+                    record.kind = log_record::kind_t::hex_dump;
+                    record.task = offset;
+                    record.success = false;
+                    record.format = nullptr;
+                    record.formatter = nullptr;
+                    record.args_size =
+                        std::min<size_t>(max_args_size, size - offset);
+                    std::memcpy(record.args, bytes + offset,
+                                record.args_size);
+                });
+            }
+        }
+
+        /**
+         * @brief 把屏幕顶部的 n 行作为状态栏，其余行显示滚动的日志。
+         * 默认没有状态栏，n 最大为 max_n_status_row。
+         */
+        void set_status_rows(int n)
+        {
+            post([&](log_record& record) {
+                record.kind = log_record::kind_t::set_layout;
+                record.task = std::clamp(n, 0, max_n_status_row);
+                record.success = false;
+                record.format = nullptr;
+                record.formatter = nullptr;
+                record.args_size = 0;
+            });
+        }
+        /**
+         * @brief 设置状态栏第 row 行的内容。只重绘这一行，内容不变时不重绘。
+         * @remark 对 format 和参数的要求同 printf()。只显示第一行。
+         * 使用 TFT_CONSOLE_SET_STATUS 可以在编译时检查格式。
+         */
+        template <typename... R>
+        void set_status(int row, const char* format, R&&... args)
+        {
+            post([&](log_record& record) {
+                record.kind = log_record::kind_t::set_status;
+                record.task = row;
+                record.success = false;
+                pack(record, format, args...);
+            });
+        }
+
+        /**
+         * @brief 因队列已满而丢弃的日志条数。
+         */
+        uint32_t dropped_records() const { return log.dropped(); }
+#if TFT_DEBUG_CONSOLE_TRACE
+        /**
+         * @brief 因串口缓冲区已满而没有导出的日志条数。
+         */
+        uint32_t dropped_trace_frames() const { return trace.dropped(); }
+#endif
+
+        struct lock_stats_t
+        {
+            uint32_t count; // 绘制线程持有 mutex_draw 的次数。
+            uint32_t p50_us;
+            uint32_t p90_us;
+            uint32_t p99_us;
+            uint32_t max_us;
+        };
+        /**
+         * @brief 绘制调度的统计。
+         */
+        frame_stats_t frame_stats()
+        {
+            rtos::ScopedMutexLock lock(mutex_draw);
+            return frame_counters;
+        }
+        /**
+         * @brief 绘制线程每帧持有 mutex_draw 的时间分布。
+         * 百分位数是所在桶的上界，精度为 2 倍。
+         * @remark TFT_DEBUG_CONSOLE_LOCKED_RENDER 为 1 时包含绘制整帧的时间。
+         */
+        lock_stats_t lock_stats()
         {
             rtos::ScopedMutexLock lock(mutex_draw);
-            console.clear();
-            cv_draw.notify_one();
+            return {lock_hold_time.count, lock_hold_time.percentile(50),
+                    lock_hold_time.percentile(90),
+                    lock_hold_time.percentile(99), lock_hold_time.max};
         }
     };
+
+    /**
+     * @brief 仅用于让编译器检查格式，没有定义。
+     */
+    __attribute__((format(printf, 1, 2))) int _tft_check_format(const char*,
+                                                                ...);
 } // namespace modules
+
+/**
+ * @brief 调用 console.printf()，并在编译时检查格式字符串与参数是否匹配。
+ */
+#define TFT_CONSOLE_PRINTF(console, format, ...)                               \
+    ((void)sizeof(::modules::_tft_check_format(format, ##__VA_ARGS__)),        \
+     (console).printf(format, ##__VA_ARGS__))
+/**
+ * @brief 调用 console.begin_task()，并在编译时检查格式字符串与参数是否匹配。
+ */
+#define TFT_CONSOLE_BEGIN_TASK(console, format, ...)                           \
+    ((void)sizeof(::modules::_tft_check_format(format, ##__VA_ARGS__)),        \
+     (console).begin_task(format, ##__VA_ARGS__))
+/**
+ * @brief 调用 console.set_status()，并在编译时检查格式字符串与参数是否匹配。
+ */
+#define TFT_CONSOLE_SET_STATUS(console, row, format, ...)                      \
+    ((void)sizeof(::modules::_tft_check_format(format, ##__VA_ARGS__)),        \
+     (console).set_status(row, format, ##__VA_ARGS__))
@@ -0,0 +1,174 @@
+/**
+ * @file tft_format.hpp
+ * @author UnnamedOrange
+ * @brief Allocation-free decimal and hexadecimal formatting.
+ *
+ * @remark The firmware links minimal-printf, which ignores field widths and
+ * zero padding, so "%02X" cannot be used for hex dumps. These functions do
+ * not parse a format string either, so they are much cheaper than snprintf().
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cinttypes>
+#include <cstddef>
+#include <system_error>
+#include <type_traits>
+
+namespace modules
+{
+    /**
+     * @brief Formatting primitives with the interface of std::to_chars().
+     *
+     * @remark The output is written to [first, last) and is not
+     * null-terminated. If the range is too small, ptr is last and ec is
+     * std::errc::value_too_large, and the content of the range is unspecified.
+     */
+    namespace tft_format
+    {
+        namespace detail
+        {
+            constexpr std::array<char, 200> make_digit_pairs()
+            {
+                std::array<char, 200> ret{};
+                for (int i = 0; i < 100; i++)
+                {
+                    ret[i * 2] = static_cast<char>('0' + i / 10);
+                    ret[i * 2 + 1] = static_cast<char>('0' + i % 10);
+                }
+                return ret;
+            }
+            // "00" "01" ... "99", so two digits are written per division.
+            inline constexpr auto digit_pairs = make_digit_pairs();
+            inline constexpr char hex_digits[] = "0123456789ABCDEF";
+            inline constexpr uint32_t powers_of_10[] = {
+                1,      10,      100,      1000,      10000,
+                100000, 1000000, 10000000, 100000000, 1000000000,
+            };
+
+            inline int bit_length(uint32_t value)
+            {
+                return 32 - __builtin_clz(value | 1);
+            }
+            /**
+             * @brief Number of decimal digits, without a loop.
+             * log10(2) is about 1233 / 4096, which gives the answer or one
+             * less, and a comparison with a power of 10 corrects it.
+             */
+            inline int n_dec_digits(uint32_t value)
+            {
+                int n = bit_length(value) * 1233 >> 12;
+                return n + (value >= powers_of_10[n]) + (value == 0);
+            }
+            template <typename T>
+            constexpr void check_integer()
+            {
+                static_assert(std::is_integral<T>::value &&
+                                  !std::is_same<T, bool>::value,
+                              "Only integers can be formatted.");
+                static_assert(sizeof(T) <= sizeof(uint32_t),
+                              "Integers wider than 32 bits are not supported.");
+            }
+        } // namespace detail
+
+        /**
+         * @brief Write an integer in decimal.
+         */
+        template <typename T>
+        std::to_chars_result to_chars_dec(char* first, char* last, T value)
+        {
+            detail::check_integer<T>();
+            uint32_t magnitude = static_cast<uint32_t>(value);
+            if constexpr (std::is_signed<T>::value)
+            {
+                if (value < 0)
+                {
+                    if (first == last)
+                        return {last, std::errc::value_too_large};
+                    *first++ = '-';
+                    magnitude = 0u - magnitude;
+                }
+            }
+            int n = detail::n_dec_digits(magnitude);
+            if (last - first < n)
+                return {last, std::errc::value_too_large};
+            char* p = first + n;
+            while (magnitude >= 100)
+            {
+                const char* pair = &detail::digit_pairs[magnitude % 100 * 2];
+                magnitude /= 100;
+                *--p = pair[1];
+                *--p = pair[0];
+            }
+            if (magnitude >= 10)
+            {
+                *--p = detail::digit_pairs[magnitude * 2 + 1];
+                *--p = detail::digit_pairs[magnitude * 2];
+            }
+            else
+                *--p = static_cast<char>('0' + magnitude);
+            return {first + n, std::errc{}};
+        }
+
+        /**
+         * @brief Write an integer in upper case hexadecimal without a prefix.
+         * Negative values are written as their two's complement.
+         *
+         * @param width Minimum number of digits. Padded with '0'.
+         */
+        template <typename T>
+        std::to_chars_result to_chars_hex(char* first, char* last, T value,
+                                          int width = 0)
+        {
+            detail::check_integer<T>();
+            using unsigned_t = std::make_unsigned_t<T>;
+            uint32_t bits = static_cast<unsigned_t>(value);
+            int n = std::max(width, (detail::bit_length(bits) + 3) / 4);
+            if (last - first < n)
+                return {last, std::errc::value_too_large};
+            for (char* p = first + n; p != first; bits >>= 4)
+                *--p = detail::hex_digits[bits & 0xF];
+            return {first + n, std::errc{}};
+        }
+
+        /**
+         * @brief Number of characters hex_dump_line() writes for size bytes.
+         */
+        constexpr size_t hex_dump_line_length(size_t size)
+        {
+            return 3 + size * 3;
+        }
+        /**
+         * @brief Write one line of a hex dump, e.g. "08: 01 A2 FF".
+         *
+         * @param offset Offset of the first byte. Only the lowest byte is
+         * written.
+         */
+        inline std::to_chars_result hex_dump_line(char* first, char* last,
+                                                  size_t offset,
+                                                  const uint8_t* data,
+                                                  size_t size)
+        {
+            if (static_cast<size_t>(last - first) <
+                hex_dump_line_length(size))
+                return {last, std::errc::value_too_large};
+            char* p = first;
+            *p++ = detail::hex_digits[offset >> 4 & 0xF];
+            *p++ = detail::hex_digits[offset & 0xF];
+            *p++ = ':';
+            for (size_t i = 0; i < size; i++)
+            {
+                *p++ = ' ';
+                *p++ = detail::hex_digits[data[i] >> 4];
+                *p++ = detail::hex_digits[data[i] & 0xF];
+            }
+            return {p, std::errc{}};
+        }
+    } // namespace tft_format
+} // namespace modules
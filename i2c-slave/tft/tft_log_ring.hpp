@@ -0,0 +1,144 @@
+/**
+ * @file tft_log_ring.hpp
+ * @author UnnamedOrange
+ * @brief Lock-free multi-producer single-consumer ring for log records.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <cstddef>
+
+namespace modules
+{
+    /**
+     * @brief Lock-free multi-producer single-consumer ring of fixed-size
+     * records.
+     *
+     * @remark Producers never block and never wait for the consumer, so
+     * push() may be called from threads and ISRs alike. When the ring is full
+     * the record is dropped and counted instead.
+     * @remark Each cell carries a sequence number (D. Vyukov's bounded queue),
+     * so a producer preempted between claiming and publishing a cell only
+     * delays the consumer at that cell; it never corrupts other records.
+     *
+     * @tparam T Type of the record. Records are filled and consumed in place.
+     * @tparam capacity Number of cells. Must be a power of 2.
+     */
+    template <typename T, size_t capacity>
+    class mpsc_ring
+    {
+        static_assert(capacity && (capacity & (capacity - 1)) == 0,
+                      "capacity must be a power of 2.");
+
+    private:
+        struct cell_t
+        {
+            std::atomic<uint32_t> sequence;
+            T value;
+        };
+        std::array<cell_t, capacity> _cells;
+        std::atomic<uint32_t> _head{}; // Next position to claim. Producers.
+        uint32_t _tail{};              // Next position to read. Consumer.
+        std::atomic<uint32_t> _n_dropped{};
+
+    public:
+        mpsc_ring()
+        {
+            for (uint32_t i = 0; i < capacity; i++)
+                _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+    public:
+        /**
+         * @brief Claim a cell, fill it and publish it.
+         *
+         * @param fill Called as fill(T&) to write the record in place.
+         * @return true if the record is published. false if the ring is full
+         * and the record is dropped.
+         */
+        template <typename fill_t>
+        bool push(fill_t&& fill)
+        {
+            uint32_t pos = _head.load(std::memory_order_relaxed);
+            while (true)
+            {
+                cell_t& cell = _cells[pos & (capacity - 1)];
+                uint32_t sequence =
+                    cell.sequence.load(std::memory_order_acquire);
+                int32_t diff = static_cast<int32_t>(sequence - pos);
+                if (diff == 0)
+                {
+                    // On failure pos is reloaded with the current head.
+                    if (_head.compare_exchange_weak(pos, pos + 1,
+                                                    std::memory_order_relaxed))
+                    {
+                        fill(cell.value);
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    _n_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                    pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+        /**
+         * @brief Number of published records that can be read in order.
+         * Only the consumer may call this function.
+         */
+        size_t readable() const
+        {
+            size_t n = 0;
+            while (n < capacity)
+            {
+                const cell_t& cell = _cells[(_tail + n) & (capacity - 1)];
+                uint32_t sequence =
+                    cell.sequence.load(std::memory_order_acquire);
+                if (sequence != _tail + n + 1)
+                    break;
+                n++;
+            }
+            return n;
+        }
+        /**
+         * @brief Read a published record without consuming it.
+         *
+         * @param index Index from the oldest record. Must be less than
+         * readable().
+         */
+        const T& peek(size_t index) const
+        {
+            return _cells[(_tail + index) & (capacity - 1)].value;
+        }
+        /**
+         * @brief Release the oldest n records to producers.
+         *
+         * @param n Must not be greater than readable().
+         */
+        void release(size_t n)
+        {
+            for (; n; n--, _tail++)
+                _cells[_tail & (capacity - 1)].sequence.store(
+                    _tail + capacity, std::memory_order_release);
+        }
+
+    public:
+        /**
+         * @brief Number of records dropped because the ring was full.
+         */
+        uint32_t dropped() const
+        {
+            return _n_dropped.load(std::memory_order_relaxed);
+        }
+    };
+} // namespace modules
@@ -0,0 +1,134 @@
+/**
+ * @file tft_trace_sink.hpp
+ * @author UnnamedOrange
+ * @brief Export console records as binary frames over a serial port.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include "mbed.h"
+
+#include <array>
+#include <cinttypes>
+#include <cstring>
+
+namespace modules
+{
+    /**
+     * @brief Header of a trace frame. All fields are little-endian.
+     *
+     * @remark A frame is the header, @ref args_size bytes of arguments and a
+     * one-byte XOR checksum of everything before it. Arguments are packed as
+     * the types printf() receives after default promotions, so a decoder can
+     * walk them with the format string alone.
+     * Hex dump frames carry the raw bytes instead.
+     * @remark The format string is sent by address. The host decoder reads
+     * the string from the ELF file of the firmware.
+     */
+    struct trace_frame_header
+    {
+        constexpr static uint8_t sync_byte = 0xA5;
+
+        uint8_t sync;      // Always sync_byte.
+        uint8_t args_size; // Number of bytes of arguments after the header.
+        uint8_t kind;      // 0 print, 1 clear, 2 begin task, 3 end task,
+                           // 4 set status, 5 set layout, 6 hex dump.
+        uint8_t flags;     // Bit 0 means success for end task.
+        uint32_t timestamp_us;
+        uint32_t task; // Row for set status. Rows of status for set layout.
+                       // Offset of the first byte for hex dump.
+        uint32_t format; // Address of the format string. 0 means none.
+    };
+    static_assert(sizeof(trace_frame_header) == 16,
+                  "trace_frame_header must not be padded.");
+
+    /**
+     * @brief Send trace frames over a serial port without blocking.
+     *
+     * @remark Frames are appended to one of two buffers while the other one
+     * is transmitted with the asynchronous serial API. write() only copies
+     * the frame. When both buffers are full the frame is dropped and counted.
+     *
+     * @tparam buffer_size Size of each buffer in bytes.
+     */
+    template <size_t buffer_size = 512>
+    class tft_trace_sink : private mbed::SerialBase
+    {
+#if !DEVICE_SERIAL_ASYNCH
+        static_assert(buffer_size == 0,
+                      "tft_trace_sink requires DEVICE_SERIAL_ASYNCH.");
+#endif
+
+    private:
+        std::array<std::array<uint8_t, buffer_size>, 2> _buffers;
+        size_t _back{};   // Index of the buffer being filled.
+        size_t _length{}; // Number of bytes in the back buffer.
+        bool _busy{};     // Whether the front buffer is being transmitted.
+        uint32_t _n_dropped{};
+
+    public:
+        tft_trace_sink(PinName tx, PinName rx, int baud)
+            : mbed::SerialBase(tx, rx, baud)
+        {
+        }
+
+    public:
+        /**
+         * @brief Append a frame and start transmitting if the port is idle.
+         *
+         * @return true if the frame is queued. false if it is dropped.
+         */
+        bool write(const void* frame, size_t size)
+        {
+            core_util_critical_section_enter();
+            bool queued = _length + size <= buffer_size;
+            if (queued)
+            {
+                std::memcpy(_buffers[_back].data() + _length, frame, size);
+                _length += size;
+                if (!_busy)
+                    _start();
+            }
+            else
+                _n_dropped++;
+            core_util_critical_section_exit();
+            return queued;
+        }
+        /**
+         * @brief Number of frames dropped because the buffers were full.
+         */
+        uint32_t dropped() const
+        {
+            return _n_dropped;
+        }
+
+    private:
+        /**
+         * @brief Swap the buffers and transmit the filled one.
+         * Called in a critical section or in the completion ISR.
+         */
+        void _start()
+        {
+            const uint8_t* front = _buffers[_back].data();
+            int length = static_cast<int>(_length);
+            _back ^= 1;
+            _length = 0;
+            _busy = true;
+            mbed::SerialBase::write(
+                front, length,
+                mbed::callback(this, &tft_trace_sink::_on_complete),
+                SERIAL_EVENT_TX_COMPLETE);
+        }
+        void _on_complete(int)
+        {
+            core_util_critical_section_enter();
+            _busy = false;
+            if (_length)
+                _start();
+            core_util_critical_section_exit();
+        }
+    };
+} // namespace modules
@@ -0,0 +1,162 @@
+/**
+ * @file console_bench.cpp
+ * @author UnnamedOrange
+ * @brief Measure the cost of logging to the TFT console on the host (Linux).
+ * @remark Build in i2c-slave with
+ * `g++ -std=c++17 -O2 -pthread -I tools/host -I . -o console_bench
+ * tools/console_bench.cpp`.
+ * @remark The times are host times. Compare the rows with each other rather
+ * than with the STM32. "snprintf" is what every printf() paid before the
+ * formatting was deferred, before it even took the console mutex. On the
+ * host, the timestamp of each record reads the system clock, which is a
+ * good part of the cost of printf().
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "tft/tft_debug_console.hpp"
+
+namespace
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    struct call_time_t
+    {
+        double first_ns; // The first call of a burst.
+        double rest_ns;  // The other calls.
+    };
+    /**
+     * @brief Log n lines in bursts of burst lines, as the I2C loop does
+     * between transactions, and time the calls.
+     * @remark The first call of a burst wakes the draw thread. On a host with
+     * few cores the scheduler may switch to it at once, so that call is
+     * timed apart from the others.
+     */
+    template <typename log_t>
+    call_time_t time_bursts(size_t n, size_t burst, log_t&& log)
+    {
+        bench_clock::duration first{}, rest{};
+        for (size_t i = 0; i < n; i += burst)
+        {
+            auto start = bench_clock::now();
+            log(static_cast<int32_t>(i));
+            auto middle = bench_clock::now();
+            for (size_t j = 1; j < burst; j++)
+                log(static_cast<int32_t>(i + j));
+            auto end = bench_clock::now();
+            first += middle - start;
+            rest += end - middle;
+            // Let the draw thread drain the ring.
+            std::this_thread::sleep_for(1ms);
+        }
+        using ns = std::chrono::duration<double, std::nano>;
+        size_t n_burst = n / burst;
+        return {ns(first).count() / n_burst,
+                ns(rest).count() / (n - n_burst)};
+    }
+    void print_call_time(const char* name, call_time_t time)
+    {
+        std::printf("  %-26s %7.1f %7.1f\n", name, time.first_ns,
+                    time.rest_ns);
+    }
+
+    struct record_t
+    {
+        uint32_t timestamp_us;
+        const char* format;
+        uint8_t args[24];
+    };
+
+    /**
+     * @brief Push n records from n_producer threads while one thread drains.
+     * A producer retries while the ring is full, so every record gets
+     * through.
+     */
+    void ring_throughput(size_t n_producer, size_t n)
+    {
+        static modules::mpsc_ring<record_t, 32> ring;
+        std::atomic<bool> done{false};
+        size_t n_read = 0;
+        uint32_t n_full = ring.dropped();
+        auto start = bench_clock::now();
+        std::thread consumer([&] {
+            while (!done.load(std::memory_order_relaxed) || ring.readable())
+            {
+                size_t readable = ring.readable();
+                n_read += readable;
+                ring.release(readable);
+                if (!readable)
+                    std::this_thread::yield();
+            }
+        });
+        std::vector<std::thread> producers;
+        for (size_t p = 0; p < n_producer; p++)
+            producers.emplace_back([n, n_producer] {
+                for (size_t i = 0; i < n / n_producer; i++)
+                    while (!ring.push([i](record_t& record) {
+                        record.timestamp_us = static_cast<uint32_t>(i);
+                        record.format = "";
+                    }))
+                        std::this_thread::yield();
+            });
+        for (auto& producer : producers)
+            producer.join();
+        done = true;
+        consumer.join();
+        double seconds =
+            std::chrono::duration<double>(bench_clock::now() - start).count();
+        std::printf("  %zu producer(s): %5.1f M records/s, full %u times\n",
+                    n_producer, n_read / seconds / 1e6,
+                    ring.dropped() - n_full);
+    }
+} // namespace
+
+int main()
+{
+    constexpr size_t n = 32768;
+    constexpr size_t burst = 16; // Half the ring.
+    auto* console = new modules::tft_debug_console;
+
+    std::printf("Per call in ns, %zu calls in bursts of %zu:\n", n, burst);
+    std::printf("  %-26s %7s %7s\n", "", "first", "rest");
+    char buffer[256];
+    print_call_time("snprintf into 256 bytes",
+                    time_bursts(n, burst, [&](int32_t value) {
+                        std::snprintf(buffer, sizeof(buffer),
+                                      "[W] Repeated %" PRId32 ".\n", value);
+                        asm volatile("" : : "r"(buffer) : "memory");
+                    }));
+    print_call_time("printf()", time_bursts(n, burst, [&](int32_t value) {
+                        TFT_CONSOLE_PRINTF(*console,
+                                           "[W] Repeated %" PRId32 ".\n",
+                                           value);
+                    }));
+    print_call_time("begin_task(), end_task()",
+                    time_bursts(n, burst, [&](int32_t value) {
+                        auto task = TFT_CONSOLE_BEGIN_TASK(
+                            *console, "Write %" PRId32 ".", value);
+                        console->end_task(task, true);
+                    }));
+    std::printf("  dropped: %" PRIu32 "\n", console->dropped_records());
+
+    // The records are formatted when the draw thread drains them, which it
+    // does with the mutex held.
+    std::this_thread::sleep_for(100ms);
+    auto lock = console->lock_stats();
+    std::printf("Draw thread, mutex held per wake-up (drain and snapshot):\n"
+                "  %" PRIu32 " times, p50 %" PRIu32 " us, p99 %" PRIu32
+                " us, max %" PRIu32 " us\n",
+                lock.count, lock.p50_us, lock.p99_us, lock.max_us);
+
+    std::printf("Ring of 32 records, %zu records:\n", n * 32);
+    for (size_t n_producer : {1, 2, 4})
+        ring_throughput(n_producer, n * 32);
+    return 0;
+}
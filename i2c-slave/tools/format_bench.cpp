@@ -0,0 +1,156 @@
+/**
+ * @file format_bench.cpp
+ * @author UnnamedOrange
+ * @brief Check tft_format.hpp against snprintf() and compare their speed on
+ * the host (Linux).
+ * @remark Build in i2c-slave with
+ * `g++ -std=c++17 -O2 -I . -o format_bench tools/format_bench.cpp`.
+ * It exits with 1 if an output differs from snprintf().
+ * @remark snprintf() here is the one of glibc. The firmware links
+ * minimal-printf, which has no field widths, so its "%02X" rows have no
+ * counterpart on the target.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include <chrono>
+#include <cinttypes>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "tft/tft_format.hpp"
+
+using namespace modules;
+
+namespace
+{
+    int n_mismatch;
+
+    void expect(const char* first, const char* last, const char* expected)
+    {
+        if (std::string_view(first, last - first) != expected)
+        {
+            std::printf("Mismatch: \"%.*s\" != \"%s\"\n",
+                        static_cast<int>(last - first), first, expected);
+            n_mismatch++;
+        }
+    }
+    template <typename T>
+    void check(T value)
+    {
+        char buf[32], expected[32];
+        std::snprintf(expected, sizeof(expected), "%lld",
+                      static_cast<long long>(value));
+        expect(buf, tft_format::to_chars_dec(buf, std::end(buf), value).ptr,
+               expected);
+        std::snprintf(expected, sizeof(expected), "%02llX",
+                      static_cast<unsigned long long>(
+                          static_cast<std::make_unsigned_t<T>>(value)));
+        expect(buf,
+               tft_format::to_chars_hex(buf, std::end(buf), value, 2).ptr,
+               expected);
+    }
+    void check_all()
+    {
+        for (uint64_t p = 1; p <= UINT32_MAX; p *= 10)
+            for (uint64_t v : {p - 1, p, p + 1})
+            {
+                if (v <= UINT32_MAX)
+                    check(static_cast<uint32_t>(v));
+                if (v <= INT32_MAX)
+                {
+                    check(static_cast<int32_t>(v));
+                    check(-static_cast<int32_t>(v));
+                }
+            }
+        check(INT32_MIN);
+        check(static_cast<int8_t>(-5));
+        check(static_cast<uint16_t>(65535));
+        std::mt19937 rng(1);
+        for (int i = 0; i < 100000; i++)
+        {
+            check(static_cast<uint32_t>(rng()));
+            check(static_cast<int32_t>(rng()));
+            check(static_cast<uint32_t>(rng() >> (rng() % 32)));
+        }
+
+        uint8_t data[] = {0x01, 0xA2, 0xFF};
+        char buf[32];
+        expect(buf,
+               tft_format::hex_dump_line(buf, std::end(buf), 8, data, 3).ptr,
+               "08: 01 A2 FF");
+        auto [ptr, ec] = tft_format::to_chars_dec(buf, buf + 2, 123);
+        if (ptr != buf + 2 || ec != std::errc::value_too_large)
+        {
+            std::printf("Overflow is not reported.\n");
+            n_mismatch++;
+        }
+    }
+
+    template <typename format_t>
+    void bench(const char* name, const std::vector<uint32_t>& values,
+               format_t&& format)
+    {
+        char buf[64];
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t value : values)
+        {
+            format(buf, value);
+            asm volatile("" : : "r"(buf) : "memory");
+        }
+        std::chrono::duration<double, std::nano> time =
+            std::chrono::steady_clock::now() - start;
+        std::printf("  %-34s %6.1f ns\n", name, time.count() / values.size());
+    }
+} // namespace
+
+int main()
+{
+    check_all();
+    std::printf("%d mismatches.\n", n_mismatch);
+
+    // Counters are mostly small, so draw the bit length uniformly.
+    std::mt19937 rng(2);
+    std::vector<uint32_t> values(1 << 20);
+    for (auto& value : values)
+        value = static_cast<uint32_t>(rng()) >> (rng() % 32);
+
+    std::printf("Per value, %zu values:\n", values.size());
+    bench("snprintf(\"%d\")", values, [](char* buf, uint32_t value) {
+        std::snprintf(buf, 64, "%" PRId32, static_cast<int32_t>(value));
+    });
+    bench("to_chars_dec()", values, [](char* buf, uint32_t value) {
+        *tft_format::to_chars_dec(buf, buf + 63, static_cast<int32_t>(value))
+             .ptr = '\0';
+    });
+    bench("snprintf(\"%02X\")", values, [](char* buf, uint32_t value) {
+        std::snprintf(buf, 64, "%02X", static_cast<unsigned>(value));
+    });
+    bench("to_chars_hex(2)", values, [](char* buf, uint32_t value) {
+        *tft_format::to_chars_hex(buf, buf + 63, value, 2).ptr = '\0';
+    });
+
+    // A row of the console's hex dump holds 6 bytes.
+    constexpr size_t row = 6;
+    std::printf("Per row of %zu bytes:\n", row);
+    auto bytes = reinterpret_cast<const uint8_t*>(values.data());
+    bench("snprintf(\"%02X:\") and 6 \" %02X\"", values,
+          [&, i = size_t{}](char* buf, uint32_t) mutable {
+              const uint8_t* data = bytes + i++ % (values.size() - 2) * 4;
+              int n = std::snprintf(buf, 64, "%02X:", data[0]);
+              for (size_t j = 0; j < row; j++)
+                  n += std::snprintf(buf + n, 64 - n, " %02X", data[j]);
+          });
+    bench("hex_dump_line()", values,
+          [&, i = size_t{}](char* buf, uint32_t) mutable {
+              const uint8_t* data = bytes + i++ % (values.size() - 2) * 4;
+              *tft_format::hex_dump_line(buf, buf + 63, data[0], data, row)
+                   .ptr = '\0';
+          });
+    return n_mismatch ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+/**
+ * @file mbed.h
+ * @author UnnamedOrange
+ * @brief Host stand-ins for the parts of Mbed OS used by tft/, so that the
+ * console can be built and benchmarked on Linux.
+ * @remark Add this directory to the include path, e.g. `-I tools/host`.
+ * Threads, mutexes, thread flags and the clocks are real. The SPI and the
+ * pins do nothing, so frames are rasterized but not transmitted.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+using namespace std::chrono_literals;
+
+enum PinName
+{
+    NC = -1,
+    PB_1,
+    PB_2,
+    PB_7,
+    PB_13,
+    PB_15,
+    PC_2,
+    USBTX,
+    USBRX,
+};
+
+inline uint32_t us_ticker_read()
+{
+    return static_cast<uint32_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+inline void core_util_critical_section_enter() {}
+inline void core_util_critical_section_exit() {}
+
+namespace mbed
+{
+    template <typename F>
+    using Callback = std::function<F>;
+    template <typename T, typename R, typename... A>
+    Callback<R(A...)> callback(T* object, R (T::*method)(A...))
+    {
+        return [object, method](A... args) {
+            return (object->*method)(args...);
+        };
+    }
+
+    class DigitalOut
+    {
+    public:
+        DigitalOut(PinName) {}
+        DigitalOut& operator=(int) { return *this; }
+    };
+    class SPI
+    {
+    public:
+        SPI(PinName, PinName, PinName) {}
+        void format(int, int) {}
+        void frequency(int) {}
+        void lock() {}
+        void unlock() {}
+        int write(int) { return -1; }
+        int write(const char*, int tx_length, char*, int) { return tx_length; }
+    };
+    class SerialBase
+    {
+    public:
+        SerialBase(PinName, PinName, int) {}
+        int write(const uint8_t*, int, const Callback<void(int)>&, int)
+        {
+            return 0;
+        }
+    };
+} // namespace mbed
+#define SERIAL_EVENT_TX_COMPLETE 2
+
+namespace rtos
+{
+    namespace Kernel
+    {
+        struct Clock
+        {
+            using duration = std::chrono::milliseconds;
+            using rep = duration::rep;
+            using period = duration::period;
+            using time_point = std::chrono::time_point<Clock>;
+            static constexpr bool is_steady = true;
+            static time_point now()
+            {
+                return time_point(std::chrono::duration_cast<duration>(
+                    std::chrono::steady_clock::now().time_since_epoch()));
+            }
+        };
+    } // namespace Kernel
+
+    class Mutex
+    {
+        std::mutex _mutex;
+
+    public:
+        void lock() { _mutex.lock(); }
+        void unlock() { _mutex.unlock(); }
+    };
+    using ScopedMutexLock = std::lock_guard<Mutex>;
+
+    /**
+     * @brief A detached std::thread with the thread flags of Mbed OS.
+     */
+    class Thread
+    {
+    public:
+        struct flags_t
+        {
+            std::mutex mutex;
+            std::condition_variable changed;
+            uint32_t value{};
+        };
+
+    private:
+        flags_t _flags;
+
+    public:
+        static inline thread_local flags_t* current{};
+
+        void start(std::function<void()> task)
+        {
+            std::thread([this, task] {
+                current = &_flags;
+                task();
+            }).detach();
+        }
+        uint32_t flags_set(uint32_t flags)
+        {
+            std::lock_guard lock{_flags.mutex};
+            if ((_flags.value & flags) != flags)
+            {
+                _flags.value |= flags;
+                _flags.changed.notify_all();
+            }
+            return _flags.value;
+        }
+    };
+
+    namespace ThisThread
+    {
+        inline void sleep_for(Kernel::Clock::duration duration)
+        {
+            std::this_thread::sleep_for(duration);
+        }
+        template <typename wait_t>
+        uint32_t _flags_wait(uint32_t flags, wait_t&& wait)
+        {
+            auto& self = *Thread::current;
+            std::unique_lock lock{self.mutex};
+            wait(lock, [&] { return self.value & flags; });
+            uint32_t ret = self.value & flags;
+            self.value &= ~ret;
+            return ret;
+        }
+        inline uint32_t flags_wait_any(uint32_t flags)
+        {
+            return _flags_wait(flags, [](auto& lock, auto ready) {
+                Thread::current->changed.wait(lock, ready);
+            });
+        }
+        inline uint32_t flags_wait_any_for(uint32_t flags,
+                                           Kernel::Clock::duration duration)
+        {
+            return _flags_wait(flags, [&](auto& lock, auto ready) {
+                Thread::current->changed.wait_for(lock, duration, ready);
+            });
+        }
+    } // namespace ThisThread
+} // namespace rtos
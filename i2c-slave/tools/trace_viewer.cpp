@@ -0,0 +1,421 @@
+/**
+ * @file trace_viewer.cpp
+ * @author UnnamedOrange
+ * @brief Decode and print console trace frames on the host (Linux).
+ * @remark Build with `g++ -std=c++17 -O2 -o trace_viewer trace_viewer.cpp`.
+ * Usage: `trace_viewer <firmware.elf> [<serial device> [baud]]`. Frames are
+ * read from stdin if the device is omitted or "-".
+ * @see tft/tft_trace_sink.hpp for the frame format.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include <elf.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std::literals;
+
+/**
+ * @brief Same layout as modules::trace_frame_header.
+ */
+struct trace_frame_header
+{
+    uint8_t sync;
+    uint8_t args_size;
+    uint8_t kind;
+    uint8_t flags;
+    uint32_t timestamp_us;
+    uint32_t task;
+    uint32_t format;
+};
+static_assert(sizeof(trace_frame_header) == 16);
+constexpr uint8_t sync_byte = 0xA5;
+
+/**
+ * @brief Read strings of the firmware by their addresses on the target.
+ */
+class elf_image
+{
+private:
+    std::vector<char> _file;
+    struct segment_t
+    {
+        uint32_t address;
+        uint32_t size;
+        uint32_t offset;
+    };
+    std::vector<segment_t> _segments;
+
+public:
+    bool load(const char* path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        _file.assign(std::istreambuf_iterator<char>(in), {});
+        if (_file.size() < sizeof(Elf32_Ehdr) ||
+            std::memcmp(_file.data(), ELFMAG, SELFMAG) ||
+            _file[EI_CLASS] != ELFCLASS32)
+            return false;
+        Elf32_Ehdr ehdr;
+        std::memcpy(&ehdr, _file.data(), sizeof(ehdr));
+        for (size_t i = 0; i < ehdr.e_phnum; i++)
+        {
+            Elf32_Phdr phdr;
+            size_t offset = ehdr.e_phoff + i * ehdr.e_phentsize;
+            if (offset + sizeof(phdr) > _file.size())
+                return false;
+            std::memcpy(&phdr, _file.data() + offset, sizeof(phdr));
+            // Strings live in flash, so use the load address.
+            if (phdr.p_type == PT_LOAD && phdr.p_filesz)
+                _segments.push_back({phdr.p_paddr, phdr.p_filesz,
+                                     phdr.p_offset});
+        }
+        return true;
+    }
+    /**
+     * @return const char* The string at the address, or nullptr.
+     */
+    const char* string_at(uint32_t address) const
+    {
+        for (const auto& segment : _segments)
+        {
+            if (address < segment.address ||
+                address - segment.address >= segment.size)
+                continue;
+            const char* begin = _file.data() + segment.offset +
+                                (address - segment.address);
+            const char* end = _file.data() + segment.offset + segment.size;
+            if (std::find(begin, end, '\0') == end)
+                return nullptr;
+            return begin;
+        }
+        return nullptr;
+    }
+};
+
+/**
+ * @brief Format the arguments like printf() on the target, where int, long
+ * and pointers have 4 bytes.
+ */
+std::string format_frame(const elf_image& elf, const char* format,
+                         const uint8_t* args, size_t args_size)
+{
+    std::string ret;
+    size_t offset = 0;
+    auto take = [&](size_t size) {
+        uint64_t value = 0;
+        if (offset + size <= args_size)
+            std::memcpy(&value, args + offset, size);
+        offset += size;
+        return value;
+    };
+    for (const char* p = format; *p; p++)
+    {
+        if (*p != '%')
+        {
+            ret.push_back(*p);
+            continue;
+        }
+        const char* spec_begin = p++;
+        if (*p == '%')
+        {
+            ret.push_back('%');
+            continue;
+        }
+        std::string spec(spec_begin, p - spec_begin);
+        auto copy_number = [&]() {
+            if (*p == '*')
+            {
+                spec += std::to_string(static_cast<int32_t>(take(4)));
+                p++;
+            }
+            else
+                while (std::isdigit(static_cast<unsigned char>(*p)))
+                    spec.push_back(*p++);
+        };
+        while (std::strchr("-+ #0", *p) && *p)
+            spec.push_back(*p++);
+        copy_number();
+        if (*p == '.')
+        {
+            spec.push_back(*p++);
+            copy_number();
+        }
+        size_t size = 4;
+        bool is_long_long = false;
+        while (std::strchr("hljztL", *p) && *p)
+        {
+            if ((p[0] == 'l' && p[1] == 'l') || *p == 'j' || *p == 'L')
+                is_long_long = true;
+            p += p[0] == 'l' && p[1] == 'l' ? 2 : 1;
+        }
+        char conversion = *p;
+        if (!conversion)
+            break;
+        char buf[512];
+        switch (conversion)
+        {
+        case 'd':
+        case 'i':
+            spec += is_long_long ? "lld"s : "d"s;
+            size = is_long_long ? 8 : 4;
+            if (is_long_long)
+                snprintf(buf, sizeof(buf), spec.c_str(),
+                         static_cast<long long>(take(size)));
+            else
+                snprintf(buf, sizeof(buf), spec.c_str(),
+                         static_cast<int32_t>(take(size)));
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            spec += is_long_long ? "ll"s + conversion : ""s + conversion;
+            size = is_long_long ? 8 : 4;
+            if (is_long_long)
+                snprintf(buf, sizeof(buf), spec.c_str(),
+                         static_cast<unsigned long long>(take(size)));
+            else
+                snprintf(buf, sizeof(buf), spec.c_str(),
+                         static_cast<uint32_t>(take(size)));
+            break;
+        case 'c':
+            spec += 'c';
+            snprintf(buf, sizeof(buf), spec.c_str(),
+                     static_cast<int>(take(4)));
+            break;
+        case 'p':
+            snprintf(buf, sizeof(buf), "0x%08" PRIx32,
+                     static_cast<uint32_t>(take(4)));
+            break;
+        case 's':
+        {
+            uint32_t address = static_cast<uint32_t>(take(4));
+            const char* str = elf.string_at(address);
+            spec += 's';
+            if (str)
+                snprintf(buf, sizeof(buf), spec.c_str(), str);
+            else
+                snprintf(buf, sizeof(buf), "<0x%08" PRIx32 ">", address);
+            break;
+        }
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+        {
+            uint64_t bits = take(8);
+            double value;
+            std::memcpy(&value, &bits, sizeof(value));
+            spec += conversion;
+            snprintf(buf, sizeof(buf), spec.c_str(), value);
+            break;
+        }
+        default:
+            snprintf(buf, sizeof(buf), "%s", spec.c_str());
+            break;
+        }
+        ret += buf;
+    }
+    return ret;
+}
+
+/**
+ * @brief Colour the line by its tag like the console does.
+ */
+const char* color_of(const std::string& text)
+{
+    if (text.size() < 3 || text[0] != '[' || text[2] != ']')
+        return "\033[0m";
+    switch (text[1])
+    {
+    case 'I':
+        return "\033[32m";
+    case 'W':
+        return "\033[33m";
+    case 'E':
+    case 'F':
+    case 'x':
+        return "\033[31m";
+    case 'D':
+    case '*':
+        return "\033[36m";
+    case '-':
+        return "\033[35m";
+    default:
+        return "\033[0m";
+    }
+}
+
+int open_serial(const char* path, int baud)
+{
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0)
+        return fd;
+    termios tio{};
+    tcgetattr(fd, &tio);
+    cfmakeraw(&tio);
+    speed_t speed = B921600;
+    switch (baud)
+    {
+    case 115200:
+        speed = B115200;
+        break;
+    case 230400:
+        speed = B230400;
+        break;
+    case 460800:
+        speed = B460800;
+        break;
+    case 921600:
+        speed = B921600;
+        break;
+    default:
+        fprintf(stderr, "Unsupported baud rate %d.\n", baud);
+        break;
+    }
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+    return fd;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr,
+                "Usage: %s <firmware.elf> [<serial device> [baud]]\n",
+                argv[0]);
+        return 1;
+    }
+    elf_image elf;
+    if (!elf.load(argv[1]))
+    {
+        fprintf(stderr, "Cannot load %s as a 32-bit ELF file.\n", argv[1]);
+        return 1;
+    }
+    int fd = STDIN_FILENO;
+    if (argc >= 3 && std::strcmp(argv[2], "-"))
+    {
+        fd = open_serial(argv[2], argc >= 4 ? std::atoi(argv[3]) : 921600);
+        if (fd < 0)
+        {
+            perror(argv[2]);
+            return 1;
+        }
+    }
+
+    std::vector<uint8_t> buffer;
+    std::unordered_map<uint32_t, std::string> tasks; // Text of open tasks.
+    uint32_t n_bad_frames = 0;
+    uint8_t chunk[256];
+    ssize_t n;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+    {
+        buffer.insert(buffer.end(), chunk, chunk + n);
+        size_t pos = 0;
+        while (true)
+        {
+            // Resynchronize on the sync byte.
+            while (pos < buffer.size() && buffer[pos] != sync_byte)
+                pos++;
+            if (buffer.size() - pos < sizeof(trace_frame_header))
+                break;
+            trace_frame_header header;
+            std::memcpy(&header, buffer.data() + pos, sizeof(header));
+            size_t size = sizeof(header) + header.args_size + 1;
+            if (buffer.size() - pos < size)
+                break;
+            uint8_t checksum = 0;
+            for (size_t i = 0; i < size; i++)
+                checksum ^= buffer[pos + i];
+            if (checksum || header.kind > 6)
+            {
+                n_bad_frames++;
+                pos++;
+                continue;
+            }
+
+            const uint8_t* args = buffer.data() + pos + sizeof(header);
+            const char* format = elf.string_at(header.format);
+            std::string text;
+            if (header.format && !format)
+            {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "<unknown format 0x%08" PRIx32 ">",
+                         header.format);
+                text = buf;
+            }
+            else if (format)
+                text = format_frame(elf, format, args, header.args_size);
+            while (!text.empty() && text.back() == '\n')
+                text.pop_back();
+
+            printf("[%5" PRIu32 ".%06" PRIu32 "] ",
+                   header.timestamp_us / 1000000,
+                   header.timestamp_us % 1000000);
+            switch (header.kind)
+            {
+            case 0: // Print.
+                printf("%s%s\033[0m\n", color_of(text), text.c_str());
+                break;
+            case 1: // Clear.
+                printf("---- clear ----\n");
+                break;
+            case 2: // Begin task.
+                tasks[header.task] = text;
+                printf("%s[-] %s\033[0m #%" PRIu32 "\n", color_of("[-]"),
+                       text.c_str(), header.task);
+                break;
+            case 3: // End task.
+            {
+                const char* tag = header.flags & 1 ? "[*]" : "[x]";
+                printf("%s%s %s\033[0m #%" PRIu32 "\n", color_of(tag), tag,
+                       tasks[header.task].c_str(), header.task);
+                tasks.erase(header.task);
+                break;
+            }
+            case 4: // Set status.
+                printf("%s[status %" PRIu32 "] %s\033[0m\n", color_of(text),
+                       header.task, text.c_str());
+                break;
+            case 5: // Set layout.
+                printf("---- %" PRIu32 " status rows ----\n", header.task);
+                break;
+            case 6: // Hex dump.
+                printf("%02" PRIX32 ":", header.task);
+                for (size_t i = 0; i < header.args_size; i++)
+                    printf(" %02X", args[i]);
+                printf("\n");
+                break;
+            }
+            pos += size;
+        }
+        buffer.erase(buffer.begin(), buffer.begin() + pos);
+        fflush(stdout);
+    }
+    if (n_bad_frames)
+        fprintf(stderr, "%" PRIu32 " bad frames skipped.\n", n_bad_frames);
+    return 0;
+}
@@ -11,12 +11,20 @@
 
 #pragma once
 
+#if ESP8266_SIMULATOR
+#include "esp8266_sim.hpp"
+#else
 #include "mbed.h"
+#endif
 
-#include <string>
 #include <chrono>
 #include <string_view>
 
+#include "esp8266_ap.hpp"
+#include "esp8266_command.hpp"
+#include "esp8266_parser.hpp"
+#include "esp8266_serial.hpp"
+
 using namespace std::literals;
 
 /**
@@ -44,21 +52,27 @@ public:
     static constexpr pin_name_t _pin_rx{ESP8266_TX};   // Exchange the tx and rx.
     static constexpr pin_name_t _pin_en{ESP8266_EN};   // 1 means enabled.
     static constexpr pin_name_t _pin_rst{ESP8266_RST}; // 1 means do not reset.
+    static constexpr int default_baud{115200};         // The default buadrate of ESP8266.
 
 private:
     static constexpr auto _default_reply_timeout{1000ms};
 
 private:
-    BufferedSerial esp{_pin_tx, _pin_rx, 115200}; // The default buadrate of ESP8266 is 115200.
+    esp8266_serial esp{_pin_tx, _pin_rx, default_baud};
     DigitalOut en{_pin_en};                       // 1 means enabled.
     DigitalOut rst{_pin_rst};                     // 1 means do not reset.
 
+    esp8266_reply_parser _parser;
+    Timer _timer;                          // Time since the latest command.
+    std::chrono::milliseconds _timeout{}; // Of the latest command.
+
 public:
     esp8266()
     {
         // Initialize EN and RST on startup.
         en = 1;  // 1 means enabled.
         rst = 1; // 1 means do not reset.
+        _timer.start();
     }
 
 private:
@@ -67,119 +81,357 @@ private:
      *
      * @param command Complete AT command.
      * @return The number of bytes written.
-     * @see BufferedSerial::write
+     * @see esp8266_serial::write
      */
     auto _write_command(const std::string_view command)
     {
         return esp.write(command.data(), command.size());
     }
+
+public:
     /**
-     * @brief Get reply from ESP8266. It waits for a specific time and reads all the buffer.
+     * @brief Write AT command and return at once. Call poll() until the reply is complete.
      *
-     * @param timeout The time to wait for the reply. You should set it to an estimated value.
-     * @return std::string The reply in string.
+     * @param command Complete AT command.
+     * @param timeout The longest time to wait for the reply. The default value is 1000ms.
+     * @param final_line The line that completes the reply instead of "OK".
+     * @see esp8266_reply_parser
      */
-    std::string _get_reply(std::chrono::milliseconds timeout = _default_reply_timeout)
+    void send(const std::string_view command, std::chrono::milliseconds timeout = _default_reply_timeout,
+              std::string_view final_line = {})
     {
-        std::string ret;
-        ThisThread::sleep_for(timeout); // Sleep for a specific time.
-        while (esp.readable())          // And then get all the buffer.
+        // Drop what is left of earlier replies, e.g. the OK of a command that has timed out, so that it does not
+        // complete this command.
+        while (esp.readable())
+            esp.consume(esp.peek().size());
+        _parser.reset(final_line);
+        _write_command(command);
+        _timeout = timeout;
+        _timer.reset();
+    }
+    /**
+     * @brief Read what has arrived without blocking. Bytes received after the final line are kept in the reply but not parsed.
+     *
+     * @return esp8266_reply_parser::result_t pending until a final result code is received or the command times out.
+     */
+    esp8266_reply_parser::result_t poll()
+    {
+        // Chunks are fed right from the receive ring.
+        while (_parser.result() == esp8266_reply_parser::result_t::pending && esp.readable())
         {
-            char ch;
-            esp.read(&ch, 1);
-            ret.push_back(ch);
+            std::string_view chunk = esp.peek();
+            _parser.feed(chunk.data(), chunk.size());
+            esp.consume(chunk.size());
         }
-        return ret;
+        if (_timer.elapsed_time() >= _timeout)
+            _parser.finish(esp8266_reply_parser::result_t::timeout);
+        return _parser.result();
+    }
+    /**
+     * @brief Wait until the reply to the latest command is complete.
+     *
+     * @return std::string_view The reply. It is valid until the next command.
+     */
+    std::string_view wait()
+    {
+        while (poll() == esp8266_reply_parser::result_t::pending)
+            ThisThread::sleep_for(1ms);
+        return reply();
     }
-
-public:
     /**
      * @brief Write AT command and get reply.
      *
      * @param command Complete AT command.
-     * @param timeout The time to wait for the reply. You should set it to an estimated value. The default value is 1000ms.
-     * @return std::string The reply in string.
+     * @param timeout The longest time to wait for the reply. The default value is 1000ms.
+     * @param final_line The line that completes the reply instead of "OK".
+     * @return std::string_view The reply. It is valid until the next command.
      */
-    std::string write_and_get_reply(const std::string_view command, std::chrono::milliseconds timeout = _default_reply_timeout)
+    std::string_view write_and_get_reply(const std::string_view command, std::chrono::milliseconds timeout = _default_reply_timeout,
+                                    std::string_view final_line = {})
     {
-        _write_command(command);
-        return _get_reply(timeout);
+        send(command, timeout, final_line);
+        return wait();
+    }
+    /**
+     * @brief The reply to the latest command received so far. It is valid until the next command.
+     */
+    std::string_view reply() const
+    {
+        return _parser.reply();
+    }
+    /**
+     * @brief Change the baud rate of the host side only. Unread bytes are discarded.
+     * @see start_set_uart()
+     */
+    void set_baud(int baud)
+    {
+        esp.set_baud(baud);
+    }
+    int baud() const
+    {
+        return static_cast<int>(esp.stats().baud);
+    }
+    /**
+     * @brief Statistics of the serial link, e.g. errors and the baud rate.
+     */
+    esp8266_serial::stats_t serial_stats() const
+    {
+        return esp.stats();
+    }
+    /**
+     * @brief Result of the latest command, e.g. timeout if no final result code is received in time.
+     */
+    esp8266_reply_parser::result_t last_result() const
+    {
+        return _parser.result();
     }
 
 public:
     /**
-     * @brief Send "AT+RST\\r\\n" to reset ESP8266.
+     * @brief Reset ESP8266 by the RST pin without waiting, which works whatever the baud rate of ESP8266 is.
+     * The host side goes back to default_baud. The reply is complete when ESP8266 is ready.
+     * @see poll()
+     */
+    void start_hard_reset()
+    {
+        rst = 0;
+        wait_us(100);
+        esp.set_baud(default_baud);
+        _parser.reset("ready");
+        _timeout = 3000ms;
+        _timer.reset();
+        rst = 1;
+    }
+    /**
+     * @brief Send "AT\\r\\n" to check the link without waiting.
+     * @see poll()
+     */
+    void start_test()
+    {
+        send("AT\r\n", 100ms);
+    }
+    /**
+     * @brief Send "AT+UART_CUR=x,8,1,0,0\\r\\n" to change the baud rate of ESP8266 without waiting.
+     * It is not saved to the flash of ESP8266, so a reset restores default_baud.
+     * @remark ESP8266 replies at the old baud rate and then switches. Call set_baud() once the reply is complete,
+     * then check the link with start_test(). If the check fails, recover with start_hard_reset().
+     * @see poll()
+     */
+    void start_set_uart(int baud)
+    {
+        send(esp8266_command<32>{"AT+UART_CUR="}.append(baud).append(",8,1,0,0").end(), 100ms);
+    }
+    /**
+     * @brief Raise the baud rate of both sides, and check the link with "AT\\r\\n".
+     *
+     * @param baud The baud rate, e.g. 921600.
+     * @return bool Whether the new baud rate works. If not, the link is at the old baud rate if ESP8266 replied
+     * ERROR, or else ESP8266 is reset by the RST pin and the link is back at default_baud.
+     * @see start_set_uart()
+     */
+    bool upgrade_baud(int baud)
+    {
+        start_set_uart(baud);
+        wait();
+        if (last_result() == esp8266_reply_parser::result_t::error)
+            return false; // Not supported, so still at the old baud rate.
+        if (last_result() == esp8266_reply_parser::result_t::ok)
+        {
+            set_baud(baud);
+            start_test();
+            wait();
+            if (last_result() == esp8266_reply_parser::result_t::ok)
+                return true;
+        }
+        start_hard_reset();
+        wait();
+        return false;
+    }
+    /**
+     * @brief Send "AT+RST\\r\\n" to reset ESP8266 without waiting.
+     * The reply is complete when ESP8266 is ready.
+     * @see poll()
+     */
+    void start_reset()
+    {
+        send("AT+RST\r\n", 3000ms, "ready");
+    }
+    /**
+     * @brief Send "AT+RST\\r\\n" to reset ESP8266 and wait until it is ready.
      *
-     * @return std::string The reply.
+     * @return std::string_view The reply. It is valid until the next command.
      */
-    std::string reset()
+    std::string_view reset()
     {
-        return write_and_get_reply("AT+RST\r\n", 100ms);
+        start_reset();
+        return wait();
+    }
+    /**
+     * @brief Send "AT+GMR\\r\\n" to get the version of ESP8266 without waiting.
+     * @see poll()
+     */
+    void start_get_version()
+    {
+        send("AT+GMR\r\n", 100ms);
     }
     /**
      * @brief Send "AT+GMR\\r\\n" to get the version of ESP8266.
      *
-     * @return std::string The reply.
+     * @return std::string_view The reply. It is valid until the next command.
+     */
+    std::string_view get_version()
+    {
+        start_get_version();
+        return wait();
+    }
+    /**
+     * @brief Send "AT+CWMODE=x\\r\\n" to set the mode of ESP8266 without waiting.
+     * @see set_mode()
      */
-    std::string get_version()
+    void start_set_mode(int mode)
     {
-        return write_and_get_reply("AT+GMR\r\n", 100ms);
+        send(esp8266_command<16>{"AT+CWMODE="}.append(mode).end(), 100ms);
     }
     /**
      * @brief Send "AT+CWMODE=x\\r\\n" to set the mode of ESP8266.
      *
      * @param mode 1 means station mode. 2 means softAP mode. 3 means station+softAP mode.
-     * @return std::string The reply.
+     * @return std::string_view The reply. It is valid until the next command.
+     */
+    std::string_view set_mode(int mode)
+    {
+        start_set_mode(mode);
+        return wait();
+    }
+    /**
+     * @brief Send "AT+CIPMUX=x\\r\\n" to set the multiplexing mode of ESP8266 without waiting.
+     * @see set_mux_mode()
      */
-    std::string set_mode(int mode)
+    void start_set_mux_mode(int mode)
     {
-        return write_and_get_reply("AT+CWMODE="s + std::to_string(mode) + "\r\n", 100ms);
+        send(esp8266_command<16>{"AT+CIPMUX="}.append(mode).end(), 100ms);
     }
     /**
      * @brief Send "AT+CIPMUX=x\\r\\n" to set the multiplexing mode of ESP8266.
      *
      * @param mode 0 means single connection. 1 means multiple connections.
-     * @return std::string The reply.
+     * @return std::string_view The reply. It is valid until the next command.
+     */
+    std::string_view set_mux_mode(int mode)
+    {
+        start_set_mux_mode(mode);
+        return wait();
+    }
+    /**
+     * @brief Send "AT+CWLAP\\r\\n" to list the access points without waiting.
+     * A scan of all channels takes a few seconds, and longer with passive scans, so the reply is bounded at 15s
+     * like AT+CWJAP. It usually completes far earlier.
+     * @see poll()
      */
-    std::string set_mux_mode(int mode)
+    void start_list_ap()
     {
-        return write_and_get_reply("AT+CIPMUX="s + std::to_string(mode) + "\r\n", 100ms);
+        send("AT+CWLAP\r\n", 15000ms);
     }
     /**
      * @brief Send "AT+CWLAP\\r\\n" to list the access points.
      *
-     * @return std::string The reply.
+     * @return std::string_view The reply. It is valid until the next command.
      */
-    std::string list_ap_raw()
+    std::string_view list_ap_raw()
     {
-        return write_and_get_reply("AT+CWLAP\r\n", 1000ms);
+        start_list_ap();
+        return wait();
+    }
+    /**
+     * @brief Send "AT+CWLAP\\r\\n" and parse the access points.
+     *
+     * @param list The access points. They are valid until the next command.
+     * @return size_t The number of access points in the list.
+     */
+    template <size_t capacity>
+    size_t list_ap(esp8266_ap_list<capacity>& list)
+    {
+        return list.parse(list_ap_raw());
+    }
+    /**
+     * @brief Send "AT+CWLAPOPT=1,31\\r\\n" without waiting, so that AT+CWLAP lists the access points from the
+     * strongest, with ecn, ssid, rssi, mac and channel only. If the reply is truncated, the weakest are lost.
+     * @see poll()
+     */
+    void start_set_list_ap_option()
+    {
+        send("AT+CWLAPOPT=1,31\r\n", 100ms);
+    }
+    /**
+     * @brief Send "AT+CWLAPOPT=1,31\\r\\n" to sort AT+CWLAP by signal strength.
+     *
+     * @return std::string_view The reply. It is valid until the next command.
+     * @see start_set_list_ap_option()
+     */
+    std::string_view set_list_ap_option()
+    {
+        start_set_list_ap_option();
+        return wait();
+    }
+    /**
+     * @brief Send "AT+CWJAP=\"SSID\",\"PASSWORD\"[,\"BSSID\"]\\r\\n" to join an access point without waiting.
+     * If the command is too long, nothing is sent and the result is error at once.
+     * @see join_ap()
+     */
+    void start_join_ap(std::string_view ssid, std::string_view password, std::string_view bssid = {})
+    {
+        // Every character may be escaped.
+        esp8266_command<16 + 2 * (32 + 64) + 20> command{"AT+CWJAP="};
+        command.quoted(ssid).append(',').quoted(password);
+        if (!bssid.empty())
+            command.append(',').quoted(bssid);
+        command.end();
+        if (!command.ok())
+        {
+            _parser.reset();
+            _parser.finish(esp8266_reply_parser::result_t::error);
+            return;
+        }
+        send(command, 15000ms);
     }
     /**
      * @brief Send "AT+CWJAP=\"SSID\",\"PASSWORD\"\\r\\n" to join an access point.
      *
-     * @param ssid The SSID of the access point.
-     * @param password The password of the access point.
-     * @return std::string The reply.
+     * @param ssid The SSID of the access point. At most 32 bytes.
+     * @param password The password of the access point. At most 64 bytes.
+     * @param bssid The MAC address of the access point, e.g. esp8266_ap::mac, if there are several with the SSID.
+     * Empty means any of them.
+     * @return std::string_view The reply. It is valid until the next command. Empty if the command is too long.
+     */
+    std::string_view join_ap(std::string_view ssid, std::string_view password, std::string_view bssid = {})
+    {
+        start_join_ap(ssid, password, bssid);
+        return wait();
+    }
+    /**
+     * @brief Send "AT+CIFSR\\r\\n" to get the IP address without waiting.
+     * @see poll()
      */
-    std::string join_ap(std::string_view ssid, std::string_view password)
+    void start_get_ip()
     {
-        return write_and_get_reply("AT+CWJAP=\""s + ssid.data() + "\",\"" + password.data() + "\"\r\n", 5000ms);
+        send("AT+CIFSR\r\n", 100ms);
     }
     /**
      * @brief Send "AT+CIFSR\\r\\n" to get the IP address.
      *
-     * @return std::string The reply.
+     * @return std::string_view The reply. It is valid until the next command.
      */
-    std::string get_ip()
+    std::string_view get_ip()
     {
-        return write_and_get_reply("AT+CIFSR\r\n", 100ms);
+        start_get_ip();
+        return wait();
     }
     /**
      * @brief Send "AT+CIPSTATUS\\r\\n" to get the connection status.
      *
-     * @return std::string The reply.
+     * @return std::string_view The reply. It is valid until the next command.
      */
-    std::string get_connection_status()
+    std::string_view get_connection_status()
     {
         return write_and_get_reply("AT+CIPSTATUS\r\n", 100ms);
     }
@@ -0,0 +1,193 @@
+/**
+ * @file esp8266_ap.hpp
+ * @author UnnamedOrange
+ * @brief Parse the access points listed by AT+CWLAP without copying.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @brief An access point in the reply to AT+CWLAP.
+ * @remark ssid and mac point into the reply, so they are valid until the next
+ * command.
+ */
+struct esp8266_ap
+{
+    int ecn; // Encryption. 0 means open.
+    std::string_view ssid;
+    int rssi; // In dBm.
+    std::string_view mac;
+    int channel;
+
+private:
+    static bool _parse_int(std::string_view text, int& value)
+    {
+        auto [end, ec] =
+            std::from_chars(text.data(), text.data() + text.size(), value);
+        return ec == std::errc{} && end == text.data() + text.size();
+    }
+
+public:
+    /**
+     * @brief Parse a line like
+     * "+CWLAP:(3,\"ssid\",-52,\"a0:b1:c2:d3:e4:f5\",6)". Fields after the
+     * channel, as printed by default, are ignored.
+     * @remark The SSID is printed as is, so it may hold '"' and ','. The
+     * fields are found from both ends, so such SSIDs are still parsed.
+     *
+     * @return bool Whether the line is a complete entry.
+     */
+    static bool parse(std::string_view line, esp8266_ap& ap)
+    {
+        constexpr std::string_view prefix = "+CWLAP:(";
+        if (line.substr(0, prefix.size()) != prefix || line.back() != ')')
+            return false;
+        line = line.substr(prefix.size(), line.size() - prefix.size() - 1);
+
+        // ecn,"ssid",rssi,"mac",channel[,...]
+        size_t ssid_begin = line.find(",\"");
+        size_t mac_begin = line.rfind(",\"");
+        if (ssid_begin == std::string_view::npos || mac_begin <= ssid_begin)
+            return false;
+        size_t mac_end = line.find('"', mac_begin + 2);
+        size_t rssi_begin = line.rfind(',', mac_begin - 1);
+        if (mac_end == std::string_view::npos || rssi_begin < ssid_begin + 3 ||
+            line[rssi_begin - 1] != '"')
+            return false;
+        std::string_view tail = line.substr(mac_end + 1);
+        if (tail.empty() || tail[0] != ',')
+            return false;
+        tail.remove_prefix(1);
+        tail = tail.substr(0, tail.find(','));
+
+        ap.ssid = line.substr(ssid_begin + 2, rssi_begin - ssid_begin - 3);
+        ap.mac = line.substr(mac_begin + 2, mac_end - mac_begin - 2);
+        return _parse_int(line.substr(0, ssid_begin), ap.ecn) &&
+               _parse_int(line.substr(rssi_begin + 1,
+                                      mac_begin - rssi_begin - 1),
+                          ap.rssi) &&
+               _parse_int(tail, ap.channel);
+    }
+    /**
+     * @brief Visit the access points in the reply to AT+CWLAP. Other lines,
+     * e.g. a line cut by a truncated reply, are skipped.
+     */
+    template <typename callback_t>
+    static void for_each(std::string_view reply, callback_t&& callback)
+    {
+        while (!reply.empty())
+        {
+            size_t end = reply.find('\n');
+            std::string_view line = reply.substr(0, end);
+            reply.remove_prefix(end == std::string_view::npos ? reply.size()
+                                                              : end + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.remove_suffix(1);
+            esp8266_ap ap;
+            if (!line.empty() && parse(line, ap))
+                callback(ap);
+        }
+    }
+};
+
+/**
+ * @brief Access points in the reply to AT+CWLAP, in fixed storage.
+ *
+ * @tparam capacity The most access points kept. The rest are counted by
+ * n_dropped().
+ */
+template <size_t capacity>
+class esp8266_ap_list
+{
+private:
+    esp8266_ap _aps[capacity];
+    size_t _size{};
+    size_t _n_dropped{};
+
+public:
+    /**
+     * @brief Replace the list with the access points in a reply.
+     *
+     * @return size_t The number of access points kept.
+     */
+    size_t parse(std::string_view reply)
+    {
+        _size = 0;
+        _n_dropped = 0;
+        esp8266_ap::for_each(reply, [this](const esp8266_ap& ap) {
+            if (_size < capacity)
+                _aps[_size++] = ap;
+            else
+                _n_dropped++;
+        });
+        return _size;
+    }
+
+public:
+    size_t size() const
+    {
+        return _size;
+    }
+    size_t n_dropped() const
+    {
+        return _n_dropped;
+    }
+    const esp8266_ap& operator[](size_t index) const
+    {
+        return _aps[index];
+    }
+    const esp8266_ap* begin() const
+    {
+        return _aps;
+    }
+    const esp8266_ap* end() const
+    {
+        return _aps + _size;
+    }
+};
+
+/**
+ * @brief A known network.
+ */
+struct esp8266_credential
+{
+    std::string_view ssid;
+    std::string_view password;
+};
+
+/**
+ * @brief Pick the known access point with the strongest signal in the reply
+ * to AT+CWLAP. If signals are equally strong, the earlier credential wins.
+ *
+ * @param best The access point picked. Not changed if none is known.
+ * @return const esp8266_credential* The credential of the access point, or
+ * nullptr if none is known.
+ */
+inline const esp8266_credential* esp8266_pick_ap(
+    std::string_view reply, const esp8266_credential* credentials,
+    size_t n_credential, esp8266_ap& best)
+{
+    const esp8266_credential* ret = nullptr;
+    esp8266_ap::for_each(reply, [&](const esp8266_ap& ap) {
+        for (size_t i = 0; i < n_credential; ++i)
+        {
+            if (credentials[i].ssid != ap.ssid)
+                continue;
+            if (!ret || ap.rssi > best.rssi ||
+                (ap.rssi == best.rssi && &credentials[i] < ret))
+            {
+                ret = &credentials[i];
+                best = ap;
+            }
+            break;
+        }
+    });
+    return ret;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file esp8266_command.hpp
+ * @author UnnamedOrange
+ * @brief Format AT commands in a fixed buffer.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @brief Builder of an AT command without heap allocation.
+ *
+ * E.g. `esp8266_command<64>{"AT+CWJAP="}.quoted(ssid).append(',')
+ * .quoted(password).end()` gives "AT+CWJAP=\"ssid\",\"password\"\r\n".
+ * If the command does not fit, ok() is false and it must not be sent.
+ *
+ * @tparam capacity Size of the buffer, including "\r\n".
+ */
+template <size_t capacity>
+class esp8266_command
+{
+private:
+    char _buffer[capacity];
+    size_t _size{};
+    bool _overflow{};
+
+public:
+    esp8266_command() = default;
+    explicit esp8266_command(std::string_view prefix)
+    {
+        append(prefix);
+    }
+
+public:
+    esp8266_command& append(std::string_view text)
+    {
+        if (text.size() > capacity - _size)
+        {
+            _overflow = true;
+            return *this;
+        }
+        text.copy(_buffer + _size, text.size());
+        _size += text.size();
+        return *this;
+    }
+    esp8266_command& append(char ch)
+    {
+        return append(std::string_view{&ch, 1});
+    }
+    esp8266_command& append(int value)
+    {
+        auto [end, ec] =
+            std::to_chars(_buffer + _size, _buffer + capacity, value);
+        if (ec != std::errc{})
+            _overflow = true;
+        else
+            _size = end - _buffer;
+        return *this;
+    }
+    /**
+     * @brief Append a string in quotes. '"', ',' and '\\' are escaped with
+     * '\\', as ESP-AT requires in SSIDs and passwords.
+     */
+    esp8266_command& quoted(std::string_view text)
+    {
+        append('"');
+        for (char ch : text)
+        {
+            if (ch == '"' || ch == ',' || ch == '\\')
+                append('\\');
+            append(ch);
+        }
+        return append('"');
+    }
+    /**
+     * @brief Terminate the command with "\r\n".
+     */
+    esp8266_command& end()
+    {
+        return append("\r\n");
+    }
+
+public:
+    bool ok() const
+    {
+        return !_overflow;
+    }
+    std::string_view view() const
+    {
+        return {_buffer, _size};
+    }
+    operator std::string_view() const
+    {
+        return view();
+    }
+};
@@ -0,0 +1,147 @@
+/**
+ * @file esp8266_parser.hpp
+ * @author UnnamedOrange
+ * @brief Parse replies of ESP8266 to AT commands line by line.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @brief Size of the buffer of a reply. Longer replies are truncated, but
+ * their final lines are still recognized.
+ * @remark You can redefine it before including this header.
+ */
+#ifndef ESP8266_REPLY_CAPACITY
+#define ESP8266_REPLY_CAPACITY 1024
+#endif // ESP8266_REPLY_CAPACITY
+
+/**
+ * @brief Incremental parser of the reply to an AT command. Bytes are fed as
+ * they arrive, and the reply is complete once a line with a final result code
+ * is received, so the caller does not have to wait for a fixed time.
+ * @remark The reply is kept in a fixed buffer that is reused by every
+ * command, so parsing never allocates.
+ */
+class esp8266_reply_parser
+{
+public:
+    enum class result_t
+    {
+        pending, // No final line yet.
+        ok,      // "OK", "SEND OK" or the expected final line.
+        error,   // "ERROR" or "SEND FAIL".
+        fail,    // "FAIL", e.g. AT+CWJAP with a wrong password.
+        timeout, // Given up by the caller. See finish().
+    };
+    static constexpr size_t capacity = ESP8266_REPLY_CAPACITY;
+
+private:
+    char _reply[capacity];
+    size_t _size{};
+    bool _truncated{};
+    // The current line, only as long as the longest final line.
+    char _line[16];
+    size_t _line_size{}; // sizeof(_line) + 1 means the line is longer.
+    std::string_view _final_line;
+    result_t _result{};
+
+    result_t _classify(std::string_view line) const
+    {
+        if (line == "ERROR" || line == "SEND FAIL")
+            return result_t::error;
+        if (line == "FAIL")
+            return result_t::fail;
+        if (_final_line.empty() ? line == "OK" || line == "SEND OK"
+                                : line == _final_line)
+            return result_t::ok;
+        return result_t::pending;
+    }
+
+public:
+    /**
+     * @brief Start parsing the reply to a new command.
+     *
+     * @param final_line The line that completes the reply instead of "OK".
+     * E.g. AT+RST replies "OK" at once but is only done at "ready". It must
+     * outlive the parsing, and it must not be longer than 16 characters.
+     */
+    void reset(std::string_view final_line = {})
+    {
+        _size = 0;
+        _truncated = false;
+        _line_size = 0;
+        _final_line = final_line;
+        _result = result_t::pending;
+    }
+    /**
+     * @brief Feed received bytes.
+     *
+     * @return result_t The result so far. Bytes fed after the final line are
+     * kept in the reply but not parsed.
+     */
+    result_t feed(const char* data, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            char ch = data[i];
+            if (_size < capacity)
+                _reply[_size++] = ch;
+            else
+                _truncated = true;
+            if (_result != result_t::pending)
+                continue;
+
+            if (ch == '\n')
+            {
+                if (_line_size <= sizeof(_line))
+                {
+                    std::string_view line{_line, _line_size};
+                    if (!line.empty() && line.back() == '\r')
+                        line.remove_suffix(1);
+                    _result = _classify(line);
+                }
+                _line_size = 0;
+            }
+            else if (_line_size < sizeof(_line))
+                _line[_line_size++] = ch;
+            else
+                _line_size = sizeof(_line) + 1;
+        }
+        return _result;
+    }
+    /**
+     * @brief End a pending reply with a result decided by the caller, e.g.
+     * timeout. Bytes fed later are still kept.
+     */
+    void finish(result_t result)
+    {
+        if (_result == result_t::pending)
+            _result = result;
+    }
+
+public:
+    /**
+     * @brief The reply received so far. It is invalidated by reset().
+     */
+    std::string_view reply() const
+    {
+        return {_reply, _size};
+    }
+    /**
+     * @brief Whether the reply did not fit in the buffer.
+     */
+    bool truncated() const
+    {
+        return _truncated;
+    }
+    result_t result() const
+    {
+        return _result;
+    }
+};
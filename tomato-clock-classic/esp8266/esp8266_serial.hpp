@@ -0,0 +1,227 @@
+/**
+ * @file esp8266_serial.hpp
+ * @author UnnamedOrange
+ * @brief Serial link to ESP8266 with DMA reception and idle line detection.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#if ESP8266_SIMULATOR
+#include "esp8266_sim.hpp"
+#else
+#include "mbed.h"
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/**
+ * @brief Size of the receive ring. It must be a power of 2.
+ * @remark You can redefine it before including this header.
+ */
+#ifndef ESP8266_RX_BUFFER_SIZE
+#define ESP8266_RX_BUFFER_SIZE 1024
+#endif // ESP8266_RX_BUFFER_SIZE
+
+/**
+ * @brief Define the USART and the DMA stream of ESP8266. USART6 RX is on
+ * DMA2 stream 1 channel 5 of STM32F401.
+ * @remark You can redefine them before including this header, together with
+ * the pins in esp8266.hpp.
+ */
+#ifndef ESP8266_USART
+#define ESP8266_USART USART6
+#define ESP8266_USART_IRQn USART6_IRQn
+#define ESP8266_DMA_STREAM DMA2_Stream1
+#define ESP8266_DMA_STREAM_IRQn DMA2_Stream1_IRQn
+#define ESP8266_DMA_CHANNEL 5
+#define ESP8266_DMA_CLEAR_FLAGS()                                             \
+    (DMA2->LIFCR = DMA_LIFCR_CTCIF1 | DMA_LIFCR_CHTIF1 | DMA_LIFCR_CTEIF1 |   \
+                   DMA_LIFCR_CDMEIF1 | DMA_LIFCR_CFEIF1)
+#endif // ESP8266_USART
+
+/**
+ * @brief UART of ESP8266 that receives into a ring by DMA.
+ *
+ * @remark The DMA stream runs in circular mode, so receiving costs no CPU
+ * time per byte. The write position is published by the idle line interrupt
+ * at the end of each burst, and by the half and complete interrupts of the
+ * DMA during long bursts, so the reader gets a reply in a few chunks instead
+ * of byte by byte.
+ * @remark Bytes are sent by polling, as commands are short.
+ * @remark There can only be one object, as it owns the interrupt vectors.
+ */
+class esp8266_serial
+{
+public:
+    static constexpr size_t buffer_size = ESP8266_RX_BUFFER_SIZE;
+    static_assert((buffer_size & (buffer_size - 1)) == 0,
+                  "ESP8266_RX_BUFFER_SIZE must be a power of 2.");
+
+    struct stats_t
+    {
+        uint32_t n_byte;    // Bytes received.
+        uint32_t n_idle;    // Idle lines, i.e. bursts received.
+        uint32_t n_dropped; // Bytes overwritten before they were read.
+        uint32_t n_overrun; // Overrun errors of the USART.
+        uint32_t n_framing; // Framing errors, e.g. a wrong baud rate.
+        uint32_t n_noise;   // Noise errors.
+        uint32_t baud;      // Current baud rate.
+    };
+
+private:
+    static inline esp8266_serial* _instance{};
+
+    UnbufferedSerial _serial;
+    alignas(4) char _buffer[buffer_size];
+    size_t _head{};               // Position of the DMA seen by the ISRs.
+    volatile uint32_t _written{}; // Bytes published by the ISRs.
+    uint32_t _read{};             // Bytes consumed by the reader.
+    stats_t _stats{};
+
+private:
+    /**
+     * @brief Publish what the DMA has written. Called by the ISRs only.
+     */
+    void _update()
+    {
+        size_t head =
+            (buffer_size - ESP8266_DMA_STREAM->NDTR) & (buffer_size - 1);
+        uint32_t n = (head - _head) & (buffer_size - 1);
+        _head = head;
+        _written = _written + n;
+        _stats.n_byte += n;
+    }
+    static void _usart_isr()
+    {
+        esp8266_serial& self = *_instance;
+        uint32_t sr = ESP8266_USART->SR;
+        if (!(sr & (USART_SR_IDLE | USART_SR_ORE | USART_SR_FE | USART_SR_NE)))
+            return;
+        // Reading SR and then DR clears the flags.
+        (void)ESP8266_USART->DR;
+        self._stats.n_overrun += !!(sr & USART_SR_ORE);
+        self._stats.n_framing += !!(sr & USART_SR_FE);
+        self._stats.n_noise += !!(sr & USART_SR_NE);
+        if (sr & USART_SR_IDLE)
+            self._stats.n_idle++;
+        self._update();
+    }
+    static void _dma_isr()
+    {
+        ESP8266_DMA_CLEAR_FLAGS();
+        _instance->_update();
+    }
+    /**
+     * @brief Start the DMA from the beginning of the ring. Unread bytes are
+     * discarded.
+     */
+    void _start()
+    {
+        NVIC_DisableIRQ(ESP8266_USART_IRQn);
+        NVIC_DisableIRQ(ESP8266_DMA_STREAM_IRQn);
+        ESP8266_USART->CR3 &= ~USART_CR3_DMAR;
+        ESP8266_DMA_STREAM->CR &= ~DMA_SxCR_EN;
+        while (ESP8266_DMA_STREAM->CR & DMA_SxCR_EN)
+            ;
+        ESP8266_DMA_CLEAR_FLAGS();
+
+        ESP8266_DMA_STREAM->PAR =
+            reinterpret_cast<uintptr_t>(&ESP8266_USART->DR);
+        ESP8266_DMA_STREAM->M0AR = reinterpret_cast<uintptr_t>(_buffer);
+        ESP8266_DMA_STREAM->NDTR = buffer_size;
+        // Peripheral to memory, bytes, circular, with half and complete
+        // interrupts.
+        ESP8266_DMA_STREAM->CR = ESP8266_DMA_CHANNEL << DMA_SxCR_CHSEL_Pos |
+                                 DMA_SxCR_MINC | DMA_SxCR_CIRC |
+                                 DMA_SxCR_HTIE | DMA_SxCR_TCIE;
+        // Keep _written at the position of the DMA, i.e. a multiple of the
+        // size of the ring.
+        _head = 0;
+        _written = (_written + buffer_size - 1) & ~(buffer_size - 1);
+        _read = _written;
+        ESP8266_DMA_STREAM->CR |= DMA_SxCR_EN;
+
+        // Clear stale flags before enabling the interrupts.
+        (void)ESP8266_USART->SR;
+        (void)ESP8266_USART->DR;
+        ESP8266_USART->CR1 =
+            (ESP8266_USART->CR1 & ~USART_CR1_RXNEIE) | USART_CR1_IDLEIE;
+        ESP8266_USART->CR3 |= USART_CR3_DMAR | USART_CR3_EIE;
+
+        NVIC_SetVector(ESP8266_USART_IRQn,
+                       reinterpret_cast<uintptr_t>(&_usart_isr));
+        NVIC_SetVector(ESP8266_DMA_STREAM_IRQn,
+                       reinterpret_cast<uintptr_t>(&_dma_isr));
+        NVIC_EnableIRQ(ESP8266_USART_IRQn);
+        NVIC_EnableIRQ(ESP8266_DMA_STREAM_IRQn);
+    }
+
+public:
+    esp8266_serial(PinName tx, PinName rx, int baud) : _serial{tx, rx, baud}
+    {
+        _stats.baud = baud;
+        _instance = this;
+        RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+        _start();
+    }
+    esp8266_serial(const esp8266_serial&) = delete;
+    esp8266_serial& operator=(const esp8266_serial&) = delete;
+
+public:
+    /**
+     * @brief Change the baud rate. Unread bytes are discarded.
+     */
+    void set_baud(int baud)
+    {
+        _serial.baud(baud);
+        _stats.baud = baud;
+        _start();
+    }
+    ssize_t write(const void* buffer, size_t size)
+    {
+        return _serial.write(buffer, size);
+    }
+    bool readable() const
+    {
+        return _written != _read;
+    }
+    /**
+     * @brief The oldest contiguous chunk of unread bytes. It stays valid until
+     * consume(), unless the reader falls a whole ring behind.
+     */
+    std::string_view peek()
+    {
+        uint32_t written = _written;
+        if (written - _read > buffer_size)
+        {
+            // The DMA has lapped the reader.
+            core_util_critical_section_enter();
+            _stats.n_dropped += written - _read - buffer_size;
+            core_util_critical_section_exit();
+            _read = written - buffer_size;
+        }
+        size_t begin = _read & (buffer_size - 1);
+        size_t size = std::min<size_t>(written - _read, buffer_size - begin);
+        return {_buffer + begin, size};
+    }
+    /**
+     * @brief Mark n bytes returned by peek() as read.
+     */
+    void consume(size_t n)
+    {
+        _read += n;
+    }
+    stats_t stats() const
+    {
+        core_util_critical_section_enter();
+        stats_t ret = _stats;
+        core_util_critical_section_exit();
+        return ret;
+    }
+};
@@ -0,0 +1,633 @@
+/**
+ * @file esp8266_sim.hpp
+ * @author UnnamedOrange
+ * @brief Scripted ESP8266 on a simulated serial link, so that the esp8266
+ * driver can be built and exercised on a host.
+ * @remark Define ESP8266_SIMULATOR to 1 (e.g. `g++ -std=c++17
+ * -DESP8266_SIMULATOR=1 ...`), and esp8266.hpp includes this header instead
+ * of mbed.h.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A fake ESP8266 running AT firmware, driven by a simulated clock.
+ *
+ * @remark Commands written by the driver are matched against the script by
+ * the longest prefix, and the replies are sent after their delays. Replies
+ * and unsolicited lines share one transmitter, so bytes arrive in order at
+ * the baud rate, and in fragments if set_fragment().
+ * @remark The clock only advances in ThisThread::sleep_for() and advance(),
+ * so a whole bring-up runs in no time and Timer measures what the hardware
+ * would take.
+ * @remark Received bytes go through a model of the USART and its DMA
+ * stream, which raises the idle line, error, half and complete interrupts
+ * at the right times, so the driver runs its real interrupt handlers.
+ */
+class esp8266_simulator
+{
+public:
+    struct reply_t
+    {
+        uint32_t delay_us; // After the command, or after the previous reply.
+        std::string text;
+    };
+
+    /**
+     * @brief Registers of the USART, the DMA stream and the NVIC used by the
+     * driver. Only what the driver touches is modeled.
+     */
+    struct hardware_t
+    {
+        struct usart_t
+        {
+            volatile uint32_t SR, DR, BRR, CR1, CR2, CR3, GTPR;
+        } usart;
+        struct dma_stream_t
+        {
+            volatile uint32_t CR, NDTR;
+            volatile uintptr_t PAR, M0AR, M1AR;
+            volatile uint32_t FCR;
+        } dma_stream;
+        struct dma_t
+        {
+            volatile uint32_t LISR, HISR, LIFCR, HIFCR;
+        } dma;
+        struct rcc_t
+        {
+            volatile uint32_t AHB1ENR;
+        } rcc;
+        uintptr_t vectors[128];
+        bool enabled[128];
+    };
+
+private:
+    hardware_t _hardware{};
+    uint32_t _dma_size{}; // NDTR when the stream was enabled.
+    bool _idle_armed{};   // A byte is received after the latest idle line.
+    uint64_t _last_rx_us{};
+    uint32_t _next_error{}; // Error flags of the next received byte.
+
+    uint64_t _now_us{};
+    std::map<std::string, std::vector<reply_t>, std::less<>> _script;
+    std::multimap<uint64_t, std::string> _events; // Not yet transmitted.
+    std::deque<std::pair<uint64_t, char>> _line;  // Bytes with arrival times.
+    uint64_t _tx_free_us{};
+    std::string _rx; // Partial command from the driver.
+    std::vector<std::string> _commands;
+    uint32_t _baud{115200};      // Of ESP8266.
+    uint32_t _host_baud{115200}; // Of the driver.
+    uint32_t _max_baud{};        // 0 means any baud rate works.
+    uint64_t _baud_switch_us{};  // When _next_baud takes effect.
+    uint32_t _next_baud{};       // 0 means no switch is pending.
+    std::vector<reply_t> _boot;  // Sent when ESP8266 boots.
+    bool _in_reset{};            // RST is held low.
+    bool _echo{true};
+    size_t _fragment_size{};
+    uint32_t _fragment_gap_us{};
+
+    uint32_t _byte_us() const
+    {
+        return (10'000'000 + _baud - 1) / _baud; // 8N1.
+    }
+    /**
+     * @brief Whether bytes get through, i.e. both sides use the same baud
+     * rate and it is not above the limit.
+     */
+    bool _link_ok() const
+    {
+        return _baud == _host_baud && (!_max_baud || _baud <= _max_baud);
+    }
+    void _switch_baud(uint64_t time)
+    {
+        if (_next_baud && time >= _baud_switch_us)
+            _baud = std::exchange(_next_baud, 0);
+    }
+    /**
+     * @brief Move the events that are due to the transmitter.
+     */
+    void _transmit()
+    {
+        while (!_events.empty() && _events.begin()->first <= _now_us)
+        {
+            auto [time, text] = *_events.begin();
+            _events.erase(_events.begin());
+            _switch_baud(time);
+            uint64_t t = std::max(time, _tx_free_us);
+            for (size_t i = 0; i < text.size(); ++i)
+            {
+                if (_fragment_size && i && i % _fragment_size == 0)
+                    t += _fragment_gap_us;
+                t += _byte_us();
+                _line.emplace_back(t, text[i]);
+            }
+            _tx_free_us = t;
+        }
+    }
+    void _on_command(const std::string& command)
+    {
+        _commands.push_back(command);
+        uint64_t t = _now_us;
+        if (_echo)
+            _events.emplace(t, command + "\r\n");
+        const std::vector<reply_t>* replies = nullptr;
+        size_t matched = 0;
+        for (const auto& [prefix, value] : _script)
+            if (prefix.size() >= matched &&
+                std::string_view{command}.substr(0, prefix.size()) == prefix)
+            {
+                replies = &value;
+                matched = prefix.size();
+            }
+        if (!replies)
+        {
+            _events.emplace(t + 1000, "\r\nERROR\r\n");
+            return;
+        }
+        for (const auto& reply : *replies)
+        {
+            t += reply.delay_us;
+            _events.emplace(t, reply.text);
+        }
+        // ESP8266 switches after it has replied at the old baud rate.
+        std::string_view uart_cur = "AT+UART_CUR=";
+        if (command.compare(0, uart_cur.size(), uart_cur) == 0 &&
+            replies->back().text.find("OK") != std::string::npos)
+        {
+            _next_baud = std::stoul(command.substr(uart_cur.size()));
+            _baud_switch_us = t + 1;
+        }
+    }
+    void _schedule(const std::vector<reply_t>& replies)
+    {
+        uint64_t t = _now_us;
+        for (const auto& reply : replies)
+        {
+            t += reply.delay_us;
+            _events.emplace(t, reply.text);
+        }
+    }
+
+public:
+    esp8266_simulator()
+    {
+        reset();
+    }
+    static esp8266_simulator& instance()
+    {
+        static esp8266_simulator simulator;
+        return simulator;
+    }
+    /**
+     * @brief Restore the default script and settings, and clear the link.
+     * The registers and the baud rate of the driver are kept, as the driver
+     * may have set them up.
+     * The default script follows ESP-AT 1.x with typical delays.
+     */
+    void reset()
+    {
+        hardware_t hardware = _hardware;
+        uint32_t dma_size = _dma_size;
+        uint32_t host_baud = _host_baud;
+        *this = esp8266_simulator{0};
+        _hardware = hardware;
+        _dma_size = dma_size;
+        _host_baud = host_baud;
+        _boot = {{50000, "\r\n ets Jan  8 2013,rst cause:2, boot mode:"
+                         "(3,7)\r\n"},
+                 {350000, "\r\nready\r\n"}};
+        on("AT", {{1000, "\r\nOK\r\n"}});
+        on("AT+RST", {{2000, "\r\nOK\r\n"}, _boot[0], _boot[1]});
+        on("AT+UART_CUR=", {{1000, "\r\nOK\r\n"}});
+        on("AT+GMR", {{5000, "AT version:1.2.0.0(Jul  1 2016 20:04:45)\r\n"
+                             "SDK version:1.5.4.1(39cb9a32)\r\n"
+                             "compile time:Dec 25 2016 14:21:22\r\n"
+                             "\r\nOK\r\n"}});
+        on("AT+CWMODE=", {{3000, "\r\nOK\r\n"}});
+        on("AT+CIPMUX=", {{3000, "\r\nOK\r\n"}});
+        on("AT+CWLAP", {{2500000, "+CWLAP:(3,\"87654321\",-52,"
+                                  "\"a0:b1:c2:d3:e4:f5\",6,-8,0)\r\n"
+                                  "+CWLAP:(4,\"PKU\",-71,"
+                                  "\"10:20:30:40:50:60\",11,-12,0)\r\n"
+                                  "+CWLAP:(0,\"guest\",-83,"
+                                  "\"02:04:06:08:0a:0c\",1,3,0)\r\n"},
+                        {1000, "\r\nOK\r\n"}});
+        on("AT+CWLAPOPT=", {{2000, "\r\nOK\r\n"}});
+        on("AT+CWJAP=", {{1500000, "WIFI CONNECTED\r\n"},
+                         {1500000, "WIFI GOT IP\r\n"},
+                         {1000, "\r\nOK\r\n"}});
+        on("AT+CIFSR", {{4000, "+CIFSR:STAIP,\"192.168.1.23\"\r\n"
+                               "+CIFSR:STAMAC,\"5c:cf:7f:00:11:22\"\r\n"
+                               "\r\nOK\r\n"}});
+        on("AT+CIPSTATUS", {{3000, "STATUS:2\r\n\r\nOK\r\n"}});
+    }
+
+private:
+    explicit esp8266_simulator(int)
+    {
+    }
+
+public:
+    /**
+     * @brief Set the replies to commands starting with prefix.
+     */
+    void on(std::string prefix, std::vector<reply_t> replies)
+    {
+        _script[std::move(prefix)] = std::move(replies);
+    }
+    /**
+     * @brief Send an unsolicited line, e.g. "+IPD,5:hello" or
+     * "WIFI DISCONNECT\r\n", after delay_us.
+     */
+    void inject(uint32_t delay_us, std::string text)
+    {
+        _events.emplace(_now_us + delay_us, std::move(text));
+    }
+    /**
+     * @brief Split replies into fragments of size bytes with gaps, like a
+     * module busy with WiFi. 0 means no gaps.
+     */
+    void set_fragment(size_t size, uint32_t gap_us)
+    {
+        _fragment_size = size;
+        _fragment_gap_us = gap_us;
+    }
+    void set_echo(bool echo)
+    {
+        _echo = echo;
+    }
+    /**
+     * @brief Set the baud rate of ESP8266. It is also changed by
+     * AT+UART_CUR and reset by booting.
+     */
+    void set_baud(uint32_t baud)
+    {
+        _baud = baud;
+    }
+    void set_host_baud(uint32_t baud)
+    {
+        _host_baud = baud;
+    }
+    uint32_t baud() const
+    {
+        return _baud;
+    }
+    /**
+     * @brief Make baud rates above max_baud unreliable, like long wires.
+     * Bytes are then garbled both ways. 0 means no limit.
+     */
+    void set_max_baud(uint32_t max_baud)
+    {
+        _max_baud = max_baud;
+    }
+    /**
+     * @brief Level of the RST pin. Holding it low silences ESP8266, and
+     * releasing it boots ESP8266 at the default baud rate.
+     */
+    void set_reset_pin(bool level)
+    {
+        if (!level && !_in_reset)
+        {
+            _events.clear();
+            _line.clear();
+            _rx.clear();
+            _next_baud = 0;
+            _tx_free_us = _now_us;
+        }
+        else if (level && _in_reset)
+        {
+            _baud = 115200;
+            _schedule(_boot);
+        }
+        _in_reset = !level;
+    }
+    /**
+     * @brief Receive the next byte with error flags of the USART, e.g.
+     * USART_SR_FE.
+     */
+    void corrupt_next_byte(uint32_t flags)
+    {
+        _next_error |= flags;
+    }
+    /**
+     * @brief Commands received so far, without "\r\n".
+     */
+    const std::vector<std::string>& commands() const
+    {
+        return _commands;
+    }
+
+private:
+    void _irq(int irq)
+    {
+        if (_hardware.enabled[irq] && _hardware.vectors[irq])
+            reinterpret_cast<void (*)()>(_hardware.vectors[irq])();
+    }
+    void _usart_event(uint32_t flags);
+    void _on_idle();
+    void _on_byte(char ch);
+
+public:
+    hardware_t& hardware()
+    {
+        return _hardware;
+    }
+    uint64_t now_us() const
+    {
+        return _now_us;
+    }
+    /**
+     * @brief Advance the clock. The bytes arriving in the meantime are
+     * received one by one at their times.
+     */
+    void advance(uint64_t duration_us)
+    {
+        uint64_t end = _now_us + duration_us;
+        for (;;)
+        {
+            _transmit();
+            uint64_t next = end + 1;
+            if (!_events.empty())
+                next = std::min(next, _events.begin()->first);
+            if (!_line.empty())
+                next = std::min(next, _line.front().first);
+            if (_idle_armed)
+                next = std::min(next, _last_rx_us + _byte_us());
+            if (next > end)
+                break;
+            _now_us = std::max(_now_us, next);
+            _transmit();
+            if (!_line.empty() && _line.front().first <= _now_us)
+            {
+                char ch = _line.front().second;
+                _line.pop_front();
+                _on_byte(ch);
+            }
+            else if (_idle_armed && _last_rx_us + _byte_us() <= _now_us)
+            {
+                _idle_armed = false;
+                _on_idle();
+            }
+        }
+        _now_us = end;
+    }
+
+public:
+    /**
+     * @brief Bytes written by the driver.
+     */
+    void receive(const char* data, size_t size)
+    {
+        _switch_baud(_now_us);
+        if (_in_reset || !_link_ok())
+            return; // Garbled, so ESP8266 does not take it as a command.
+        for (size_t i = 0; i < size; ++i)
+        {
+            _rx.push_back(data[i]);
+            if (_rx.size() >= 2 && _rx.compare(_rx.size() - 2, 2, "\r\n") == 0)
+            {
+                _rx.resize(_rx.size() - 2);
+                _on_command(_rx);
+                _rx.clear();
+            }
+        }
+    }
+};
+
+/**
+ * @brief Stand-ins of mbed used by esp8266.hpp.
+ */
+enum PinName
+{
+    PC_6 = 0x26,
+    PC_7,
+    PC_8,
+    PC_9,
+};
+
+/**
+ * @remark PC_9 is taken as RST of ESP8266.
+ */
+class DigitalOut
+{
+private:
+    PinName _pin;
+    int _value{};
+
+public:
+    explicit DigitalOut(PinName pin, int value = 0) : _pin{pin}, _value{value}
+    {
+    }
+    DigitalOut& operator=(int value)
+    {
+        _value = value;
+        if (_pin == PC_9)
+            esp8266_simulator::instance().set_reset_pin(value);
+        return *this;
+    }
+    operator int() const
+    {
+        return _value;
+    }
+};
+
+class UnbufferedSerial
+{
+public:
+    UnbufferedSerial(PinName, PinName, int baud)
+    {
+        esp8266_simulator::instance().set_host_baud(baud);
+    }
+    void baud(int baud)
+    {
+        esp8266_simulator::instance().set_host_baud(baud);
+    }
+    ssize_t write(const void* buffer, size_t size)
+    {
+        esp8266_simulator::instance().receive(
+            static_cast<const char*>(buffer), size);
+        return static_cast<ssize_t>(size);
+    }
+};
+
+/**
+ * @brief Stand-ins of the CMSIS definitions used by esp8266_serial.hpp.
+ */
+#define USART6 (&esp8266_simulator::instance().hardware().usart)
+#define DMA2 (&esp8266_simulator::instance().hardware().dma)
+#define DMA2_Stream1 (&esp8266_simulator::instance().hardware().dma_stream)
+#define RCC (&esp8266_simulator::instance().hardware().rcc)
+
+#define USART_SR_NE (1u << 2)
+#define USART_SR_FE (1u << 1)
+#define USART_SR_ORE (1u << 3)
+#define USART_SR_IDLE (1u << 4)
+#define USART_CR1_IDLEIE (1u << 4)
+#define USART_CR1_RXNEIE (1u << 5)
+#define USART_CR3_EIE (1u << 0)
+#define USART_CR3_DMAR (1u << 6)
+#define DMA_SxCR_EN (1u << 0)
+#define DMA_SxCR_HTIE (1u << 3)
+#define DMA_SxCR_TCIE (1u << 4)
+#define DMA_SxCR_CIRC (1u << 8)
+#define DMA_SxCR_MINC (1u << 10)
+#define DMA_SxCR_CHSEL_Pos 25
+#define DMA_LISR_HTIF1 (1u << 10)
+#define DMA_LISR_TCIF1 (1u << 11)
+#define DMA_LIFCR_CFEIF1 (1u << 6)
+#define DMA_LIFCR_CDMEIF1 (1u << 8)
+#define DMA_LIFCR_CTEIF1 (1u << 9)
+#define DMA_LIFCR_CHTIF1 (1u << 10)
+#define DMA_LIFCR_CTCIF1 (1u << 11)
+#define RCC_AHB1ENR_DMA2EN (1u << 22)
+
+enum IRQn_Type
+{
+    DMA2_Stream1_IRQn = 57,
+    USART6_IRQn = 71,
+};
+inline void NVIC_SetVector(IRQn_Type irq, uintptr_t vector)
+{
+    esp8266_simulator::instance().hardware().vectors[irq] = vector;
+}
+inline void NVIC_EnableIRQ(IRQn_Type irq)
+{
+    esp8266_simulator::instance().hardware().enabled[irq] = true;
+}
+inline void NVIC_DisableIRQ(IRQn_Type irq)
+{
+    esp8266_simulator::instance().hardware().enabled[irq] = false;
+}
+inline void core_util_critical_section_enter()
+{
+}
+inline void core_util_critical_section_exit()
+{
+}
+
+/**
+ * @brief Raise an interrupt of the USART. Reading SR and then DR clears the
+ * flags on the hardware, so they are cleared after the handler.
+ */
+inline void esp8266_simulator::_usart_event(uint32_t flags)
+{
+    auto& usart = _hardware.usart;
+    usart.SR = usart.SR | flags;
+    bool enabled = (flags & USART_SR_IDLE && usart.CR1 & USART_CR1_IDLEIE) ||
+                   (flags & ~USART_SR_IDLE && usart.CR3 & USART_CR3_EIE);
+    if (enabled)
+        _irq(USART6_IRQn);
+    usart.SR = usart.SR & ~flags;
+}
+inline void esp8266_simulator::_on_idle()
+{
+    _usart_event(USART_SR_IDLE);
+}
+/**
+ * @brief Receive a byte by the DMA stream in circular mode. Without DMA,
+ * nobody reads the USART, so the byte overruns.
+ */
+inline void esp8266_simulator::_on_byte(char ch)
+{
+    auto& usart = _hardware.usart;
+    auto& stream = _hardware.dma_stream;
+    _idle_armed = true;
+    _last_rx_us = _now_us;
+    uint32_t error = std::exchange(_next_error, 0);
+    if (!_link_ok())
+    {
+        ch = static_cast<char>(ch ^ 0x5A);
+        error |= USART_SR_FE;
+    }
+
+    if (!(stream.CR & DMA_SxCR_EN))
+        _dma_size = 0;
+    else if (!_dma_size)
+        _dma_size = stream.NDTR;
+    if (usart.CR3 & USART_CR3_DMAR && stream.CR & DMA_SxCR_EN)
+    {
+        reinterpret_cast<char*>(stream.M0AR)[_dma_size - stream.NDTR] = ch;
+        stream.NDTR = stream.NDTR - 1;
+        uint32_t flags = 0;
+        if (stream.NDTR == _dma_size / 2)
+            flags = DMA_LISR_HTIF1;
+        if (stream.NDTR == 0)
+        {
+            flags = DMA_LISR_TCIF1;
+            stream.NDTR = _dma_size; // Circular.
+        }
+        auto& dma = _hardware.dma;
+        dma.LISR = dma.LISR | flags;
+        if ((flags & DMA_LISR_HTIF1 && stream.CR & DMA_SxCR_HTIE) ||
+            (flags & DMA_LISR_TCIF1 && stream.CR & DMA_SxCR_TCIE))
+            _irq(DMA2_Stream1_IRQn);
+        dma.LISR = 0; // Cleared by writing LIFCR.
+    }
+    else
+        error |= USART_SR_ORE;
+    if (error)
+        _usart_event(error);
+}
+
+class Timer
+{
+private:
+    uint64_t _start_us{};
+    uint64_t _elapsed_us{};
+    bool _running{};
+
+public:
+    void start()
+    {
+        if (!_running)
+            _start_us = esp8266_simulator::instance().now_us();
+        _running = true;
+    }
+    void stop()
+    {
+        _elapsed_us = elapsed_time().count();
+        _running = false;
+    }
+    void reset()
+    {
+        _start_us = esp8266_simulator::instance().now_us();
+        _elapsed_us = 0;
+    }
+    std::chrono::microseconds elapsed_time() const
+    {
+        uint64_t running =
+            _running ? esp8266_simulator::instance().now_us() - _start_us : 0;
+        return std::chrono::microseconds(_elapsed_us + running);
+    }
+};
+
+namespace ThisThread
+{
+    template <typename rep_t, typename period_t>
+    void sleep_for(std::chrono::duration<rep_t, period_t> duration)
+    {
+        esp8266_simulator::instance().advance(
+            std::chrono::duration_cast<std::chrono::microseconds>(duration)
+                .count());
+    }
+} // namespace ThisThread
+
+inline void wait_us(int us)
+{
+    esp8266_simulator::instance().advance(us);
+}
@@ -0,0 +1,330 @@
+/**
+ * @file esp8266_wifi.hpp
+ * @author UnnamedOrange
+ * @brief Bring up WiFi of ESP8266 in the background of the main loop.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string_view>
+
+#include "esp8266.hpp"
+
+/**
+ * @brief Non-blocking state machine that resets ESP8266, joins an access
+ * point and gets the IP address.
+ *
+ * @remark Given a list of known networks, it scans once with AT+CWLAP and
+ * joins the strongest known access point by its BSSID, so a reconnection
+ * takes one scan and one join. Given a single network, it joins without a
+ * scan.
+ * @remark Call poll() from the main loop. Each call only reads what has
+ * arrived and sends the next command, so the loop keeps drawing while ESP8266
+ * is busy, e.g. for seconds in AT+CWJAP.
+ * @remark If a faster baud rate is given, it is set up right after the reset
+ * and checked with "AT". If the check fails, ESP8266 is reset by the RST pin
+ * and the bring-up goes on at the default baud rate, which is then kept for
+ * retries.
+ * @remark If a step fails, it starts over from the reset after
+ * retry_interval.
+ */
+class esp8266_wifi
+{
+public:
+    enum class status_t
+    {
+        idle,       // start() is not called yet.
+        connecting, // A step is in progress.
+        connected,  // Got the IP address.
+        failed,     // Waiting to retry.
+    };
+    static constexpr auto retry_interval{10s};
+
+private:
+    enum class step_t
+    {
+        reset,
+        set_uart,
+        check_uart,
+        recover, // Back to the default baud rate.
+        set_mode,
+        set_mux_mode,
+        set_list_ap_option,
+        list_ap,
+        join_ap,
+        get_ip,
+        done,
+    };
+
+    esp8266& _esp;
+    esp8266_credential _single; // The network if not given a list.
+    const esp8266_credential* _credentials;
+    size_t _n_credential;
+    bool _scan; // Whether to pick from a scan.
+    int _baud;
+    const esp8266_credential* _picked{};
+    char _bssid[17]; // "a0:b1:c2:d3:e4:f5"
+    size_t _bssid_size{};
+    status_t _status{};
+    step_t _step{};
+    Timer _retry_timer;
+    char _ip[16]{}; // "255.255.255.255" at most.
+    size_t _ip_size{};
+
+private:
+    void _start_step()
+    {
+        switch (_step)
+        {
+        case step_t::reset:
+            // AT+RST is not understood if the baud rates do not match.
+            if (_esp.baud() == esp8266::default_baud)
+                _esp.start_reset();
+            else
+                _esp.start_hard_reset();
+            break;
+        case step_t::set_uart:
+            _esp.start_set_uart(_baud);
+            break;
+        case step_t::check_uart:
+            _esp.start_test();
+            break;
+        case step_t::recover:
+            _esp.start_hard_reset();
+            break;
+        case step_t::set_mode:
+            _esp.start_set_mode(3);
+            break;
+        case step_t::set_mux_mode:
+            _esp.start_set_mux_mode(0);
+            break;
+        case step_t::set_list_ap_option:
+            _esp.start_set_list_ap_option();
+            break;
+        case step_t::list_ap:
+            _esp.start_list_ap();
+            break;
+        case step_t::join_ap:
+            _esp.start_join_ap(_picked->ssid, _picked->password,
+                               {_bssid, _bssid_size});
+            break;
+        case step_t::get_ip:
+            _esp.start_get_ip();
+            break;
+        case step_t::done:
+            break;
+        }
+    }
+    /**
+     * @brief Take the IP address from a reply like
+     * "+CIFSR:STAIP,\"192.168.1.23\"".
+     */
+    void _parse_ip(std::string_view reply)
+    {
+        constexpr std::string_view key = "+CIFSR:STAIP,\"";
+        _ip_size = 0;
+        size_t begin = reply.find(key);
+        if (begin == std::string_view::npos)
+            return;
+        begin += key.size();
+        size_t end = reply.find('"', begin);
+        if (end == std::string_view::npos || end - begin > sizeof(_ip))
+            return;
+        _ip_size = reply.copy(_ip, end - begin, begin);
+    }
+    /**
+     * @brief Go to the next step after the current one is complete.
+     *
+     * @return bool Whether the bring-up can go on.
+     */
+    bool _next(esp8266_reply_parser::result_t result)
+    {
+        bool ok = result == esp8266_reply_parser::result_t::ok;
+        switch (_step)
+        {
+        case step_t::reset:
+            if (!ok)
+                return false;
+            _step = _baud == esp8266::default_baud ? step_t::set_mode
+                                                    : step_t::set_uart;
+            return true;
+        case step_t::set_uart:
+            if (!ok)
+            {
+                // ERROR means it is not supported, so ESP8266 is still at
+                // the default. Otherwise the baud rate is unknown.
+                _baud = esp8266::default_baud;
+                _step = result == esp8266_reply_parser::result_t::error
+                            ? step_t::set_mode
+                            : step_t::recover;
+                return true;
+            }
+            _esp.set_baud(_baud);
+            _step = step_t::check_uart;
+            return true;
+        case step_t::check_uart:
+            if (ok)
+                _step = step_t::set_mode;
+            else
+            {
+                _baud = esp8266::default_baud;
+                _step = step_t::recover;
+            }
+            return true;
+        case step_t::recover:
+            _step = step_t::set_mode;
+            return ok;
+        case step_t::set_mux_mode:
+            if (!ok)
+                return false;
+            _step = _scan ? step_t::set_list_ap_option : step_t::join_ap;
+            return true;
+        case step_t::set_list_ap_option:
+            // Old firmware without AT+CWLAPOPT lists in the default format,
+            // which is parsed as well.
+            _step = step_t::list_ap;
+            return true;
+        case step_t::list_ap:
+        {
+            if (!ok)
+                return false;
+            esp8266_ap best;
+            _picked = esp8266_pick_ap(_esp.reply(), _credentials,
+                                      _n_credential, best);
+            if (!_picked)
+                return false; // No known network is in range.
+            _bssid_size = best.mac.copy(_bssid, sizeof(_bssid));
+            _step = step_t::join_ap;
+            return true;
+        }
+        case step_t::get_ip:
+            if (!ok)
+                return false;
+            _parse_ip(_esp.reply());
+            _step = step_t::done;
+            return true;
+        default:
+            if (!ok)
+                return false;
+            _step = static_cast<step_t>(static_cast<int>(_step) + 1);
+            return true;
+        }
+    }
+    void _fail()
+    {
+        _status = status_t::failed;
+        _retry_timer.reset();
+        _retry_timer.start();
+    }
+
+public:
+    /**
+     * @param esp The driver. It must not be used by others until connected.
+     * @param ssid The SSID of the access point. It must outlive this object.
+     * @param password The password of the access point. It must outlive this
+     * object.
+     * @param baud The baud rate to use after the reset, e.g. 921600.
+     */
+    esp8266_wifi(esp8266& esp, std::string_view ssid,
+                 std::string_view password,
+                 int baud = esp8266::default_baud)
+        : _esp{esp}, _single{ssid, password}, _credentials{&_single},
+          _n_credential{1}, _scan{false}, _baud{baud}
+    {
+        _picked = &_single;
+    }
+    /**
+     * @param esp The driver. It must not be used by others until connected.
+     * @param credentials The known networks. They must outlive this object.
+     * @param baud The baud rate to use after the reset, e.g. 921600.
+     */
+    template <size_t n_credential>
+    esp8266_wifi(esp8266& esp,
+                 const esp8266_credential (&credentials)[n_credential],
+                 int baud = esp8266::default_baud)
+        : _esp{esp}, _single{}, _credentials{credentials},
+          _n_credential{n_credential}, _scan{true}, _baud{baud}
+    {
+    }
+    esp8266_wifi(const esp8266_wifi&) = delete;
+    esp8266_wifi& operator=(const esp8266_wifi&) = delete;
+
+public:
+    /**
+     * @brief Start over from the reset. It returns at once.
+     */
+    void start()
+    {
+        _status = status_t::connecting;
+        _step = step_t::reset;
+        _ip_size = 0;
+        if (_scan)
+        {
+            _picked = nullptr;
+            _bssid_size = 0;
+        }
+        _start_step();
+    }
+    /**
+     * @brief Advance the state machine without blocking. Call it in the main
+     * loop.
+     *
+     * @return status_t The status after this call.
+     */
+    status_t poll()
+    {
+        if (_status == status_t::failed &&
+            _retry_timer.elapsed_time() >= retry_interval)
+            start();
+        while (_status == status_t::connecting)
+        {
+            auto result = _esp.poll();
+            if (result == esp8266_reply_parser::result_t::pending)
+                break;
+            if (!_next(result))
+            {
+                _fail();
+                break;
+            }
+            if (_step == step_t::done)
+                _status = status_t::connected;
+            else
+                _start_step(); // The next command is sent at once.
+        }
+        return _status;
+    }
+
+public:
+    status_t status() const
+    {
+        return _status;
+    }
+    /**
+     * @brief The baud rate in use, or to be tried at the next start().
+     */
+    int baud() const
+    {
+        return _baud;
+    }
+    /**
+     * @brief The network joined or being joined. nullptr before a scan picks
+     * one.
+     */
+    const esp8266_credential* network() const
+    {
+        return _picked;
+    }
+    /**
+     * @brief The IP address of the station. Empty if not connected.
+     */
+    std::string_view ip() const
+    {
+        return _status == status_t::connected ? std::string_view{_ip, _ip_size}
+                                              : std::string_view{};
+    }
+};
@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "esp8266/esp8266.hpp"
+#include "esp8266/esp8266_wifi.hpp"
 #include "tft/GUI.h"
 #include "tft/Lcd_Driver.h"
 #include "tft/Picture.hpp"
@@ -211,6 +212,16 @@ private:
     static constexpr auto _default_duration_work = 25min;
     static constexpr auto _default_duration_rest = 5min;
     static constexpr auto _default_step = 5min;
+    static constexpr auto _welcome_duration = 1s; // Of the welcome screen.
+
+    /**
+     * @brief Define the known WiFi networks. The strongest one in range is
+     * joined.
+     */
+private:
+    static constexpr esp8266_credential _wifi_networks[]{
+        {"87654321", "87654321"},
+    };
 
     /**
      * @brief Define the Mbed pin objects.
@@ -226,6 +237,7 @@ private:
     PwmOut m_buzzer_pwm{PA_15};
 
     esp8266 m_esp8266; // Pins are defined in the header.
+    esp8266_wifi m_wifi{m_esp8266, _wifi_networks, 921600};
 
     /**
      * @brief Define the states of the program.
@@ -251,6 +263,8 @@ private:
         red_tomato,
         green_tomato,
     } m_state_drawing{};
+    esp8266_wifi::status_t m_wifi_status{}; // Status shown on the screen.
+    sys_clock::time_point m_welcome_end{}; // End of the welcome screen.
 
     /**
      * @brief audio.
@@ -293,6 +307,30 @@ private:
             Gui_DrawFont_GBK16(36, 62, BLUE, WHITE,
                                reinterpret_cast<const u8*>("Resting"));
     }
+    /**
+     * @brief Draw a dot at the top right corner. Gray means connecting, green
+     * means connected and red means failed.
+     */
+    void gui_show_wifi_status(esp8266_wifi::status_t status)
+    {
+        u16 color = WHITE;
+        switch (status)
+        {
+        case esp8266_wifi::status_t::idle:
+            break;
+        case esp8266_wifi::status_t::connecting:
+            color = GRAY1;
+            break;
+        case esp8266_wifi::status_t::connected:
+            color = GREEN;
+            break;
+        case esp8266_wifi::status_t::failed:
+            color = RED;
+            break;
+        }
+        for (u16 r = 1; r <= 3; r++)
+            Gui_Circle(122, 5, r, color);
+    }
     u8 TX(u8 n)
     {
         if (n < 5)
@@ -391,9 +429,19 @@ private:
             transfer_state();
 
         m_audio.on_update();
+        update_wifi();
     }
     void draw()
     {
+        // The loop keeps running behind the welcome screen, e.g. to bring up
+        // WiFi. The main screen replaces it when the time is up.
+        if (m_welcome_end != sys_clock::time_point{})
+        {
+            if (g_now() < m_welcome_end)
+                return;
+            m_welcome_end = {};
+            show_main_screen();
+        }
         auto remaining = _get_remaining_time();
         gui_show_time(remaining);
         if (m_state_drawing != state_drawing_t::idle)
@@ -405,28 +453,54 @@ private:
                      TX(m_num_tomatoes) + 30, TY(m_num_tomatoes) + 32);
             m_state_drawing = state_drawing_t::idle;
         }
+        if (m_wifi.status() != m_wifi_status)
+        {
+            m_wifi_status = m_wifi.status();
+            gui_show_wifi_status(m_wifi_status);
+        }
     }
 
 private:
-    bool setup_wifi()
+    /**
+     * @brief Replace the welcome screen with the main screen, start the
+     * period and enable the buttons, which would otherwise change the period
+     * behind the welcome screen.
+     */
+    void show_main_screen()
     {
-        auto wrapper = [&](const std::string& reply) {
-            printf("%s\n", reply.c_str());
-            return reply.find("OK") != std::string::npos;
-        };
-
-        string_view ssid = "87654321";
-        string_view password = "87654321";
-        if (!wrapper(m_esp8266.reset()))
-            return false;
-        wrapper(m_esp8266.get_version());
-        wrapper(m_esp8266.set_mode(3));
-        wrapper(m_esp8266.set_mux_mode(0));
-        wrapper(m_esp8266.list_ap_raw());
-        wrapper(m_esp8266.join_ap(ssid, password));
-        wrapper(m_esp8266.get_ip());
-        wrapper(m_esp8266.get_connection_status());
-        return true;
+        gui_draw_background();
+        gui_show_message(m_state);
+        m_current_start_time = g_now();
+
+        // Setup the interrupts.
+        m_button_middle.set_callback(std::bind(&Main::transfer_state, this));
+        m_button_left.set_callback(std::bind(&Main::on_time_up, this));
+        m_button_right.set_callback(std::bind(&Main::on_time_down, this));
+    }
+    /**
+     * @brief Advance the WiFi bring-up. It never blocks, so the clock runs
+     * while ESP8266 is busy.
+     */
+    void update_wifi()
+    {
+        auto old_status = m_wifi.status();
+        auto status = m_wifi.poll();
+        if (status == old_status)
+            return;
+        if (status == esp8266_wifi::status_t::connected)
+        {
+            // minimal-printf does not support precision, so "%.*s" is not
+            // used.
+            auto ssid = m_wifi.network()->ssid;
+            auto ip = m_wifi.ip();
+            fputs("WiFi connected to ", stdout);
+            fwrite(ssid.data(), 1, ssid.size(), stdout);
+            fputs(": ", stdout);
+            fwrite(ip.data(), 1, ip.size(), stdout);
+            printf(" (%d baud)\n", m_esp8266.baud());
+        }
+        else if (status == esp8266_wifi::status_t::failed)
+            puts("WiFi failed. Retrying later.");
     }
 
 public:
@@ -441,15 +515,12 @@ public:
         Lcd_Init(0);
         Lcd_On();
 
-        // Show the welcome screen.
+        // Show the welcome screen without waiting. See draw().
         gui_show_welcome();
+        m_welcome_end = g_now() + _welcome_duration;
 
-        // Setup WiFi.
-        if (!setup_wifi())
-            rtos::ThisThread::sleep_for(1s);
-
-        // Draw the background.
-        gui_draw_background();
+        // Setup WiFi in the background. See update_wifi().
+        m_wifi.start();
 
         // Initialize the states.
         m_state = state_t::work;
@@ -457,18 +528,12 @@ public:
         m_current_duration = _default_duration_work;
         m_num_tomatoes = 0;
 
-        // Show the main screen and activate the peripherals.
-        gui_show_message(m_state);
+        // Activate the peripherals.
         m_led_g = 0;
         m_led_r = 1;
         m_led_b = 1;
         m_audio.set_mute(false); // Enable the buzzer.
 
-        // Setup the interrupts.
-        m_button_middle.set_callback(std::bind(&Main::transfer_state, this));
-        m_button_left.set_callback(std::bind(&Main::on_time_up, this));
-        m_button_right.set_callback(std::bind(&Main::on_time_down, this));
-
         // Update the screen.
         while (true)
         {
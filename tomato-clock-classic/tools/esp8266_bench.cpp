@@ -0,0 +1,157 @@
+/**
+ * @file esp8266_bench.cpp
+ * @author UnnamedOrange
+ * @brief Compare the bring-up time of the old fixed-sleep reply and of the
+ * esp8266 driver on the default script of the ESP8266 simulator.
+ * @remark Build in tomato-clock-classic with
+ * `g++ -std=c++17 -O2 -DESP8266_SIMULATOR=1 -I . -o esp8266_bench
+ * tools/esp8266_bench.cpp`. It exits with 1 if the driver does not get
+ * the IP address.
+ * @remark The times are simulated, so they are what the hardware would take
+ * and do not depend on the host.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include <cstdio>
+#include <string>
+
+#include "esp8266/esp8266.hpp"
+#include "esp8266/esp8266_wifi.hpp"
+
+using namespace std::literals;
+
+namespace
+{
+    auto& sim = esp8266_simulator::instance();
+
+    /**
+     * @brief The driver before replies completed early. Each command sleeps
+     * for its whole timeout and then takes whatever has arrived.
+     */
+    class old_esp8266
+    {
+    private:
+        esp8266_serial esp{esp8266::_pin_tx, esp8266::_pin_rx,
+                           esp8266::default_baud};
+        DigitalOut en{esp8266::_pin_en, 1};
+        DigitalOut rst{esp8266::_pin_rst, 1};
+
+        std::string _get_reply(std::chrono::milliseconds timeout)
+        {
+            std::string ret;
+            ThisThread::sleep_for(timeout);
+            while (esp.readable())
+            {
+                auto chunk = esp.peek();
+                ret += chunk;
+                esp.consume(chunk.size());
+            }
+            return ret;
+        }
+
+    public:
+        std::string write_and_get_reply(std::string_view command,
+                                        std::chrono::milliseconds timeout)
+        {
+            esp.write(command.data(), command.size());
+            return _get_reply(timeout);
+        }
+    };
+
+    bool ok(std::string_view reply)
+    {
+        return reply.find("OK") != reply.npos;
+    }
+
+    /**
+     * @brief setup_wifi() of the old main.cpp, with the timeouts it had.
+     */
+    void old_setup_wifi()
+    {
+        old_esp8266 esp;
+        uint64_t start_us = sim.now_us();
+        int n_ok = 0;
+        n_ok += ok(esp.write_and_get_reply("AT+RST\r\n", 100ms));
+        n_ok += ok(esp.write_and_get_reply("AT+GMR\r\n", 100ms));
+        n_ok += ok(esp.write_and_get_reply("AT+CWMODE=3\r\n", 100ms));
+        n_ok += ok(esp.write_and_get_reply("AT+CIPMUX=0\r\n", 100ms));
+        n_ok += ok(esp.write_and_get_reply("AT+CWLAP\r\n", 1000ms));
+        n_ok += ok(esp.write_and_get_reply(
+            "AT+CWJAP=\"87654321\",\"87654321\"\r\n", 5000ms));
+        std::string ip = esp.write_and_get_reply("AT+CIFSR\r\n", 100ms);
+        n_ok += ok(ip);
+        n_ok += ok(esp.write_and_get_reply("AT+CIPSTATUS\r\n", 100ms));
+        double seconds = (sim.now_us() - start_us) / 1e6;
+        std::printf("  old fixed sleeps:  %.2f s, %d of 8 replies with OK, "
+                    "IP %s\n",
+                    seconds, n_ok,
+                    ip.find("192.168.1.23") != ip.npos ? "found" : "missing");
+    }
+
+    /**
+     * @brief The same commands on the esp8266 driver.
+     */
+    bool new_setup_wifi(esp8266& esp)
+    {
+        uint64_t start_us = sim.now_us();
+        int n_ok = 0;
+        auto count = [&] {
+            n_ok += esp.last_result() == esp8266_reply_parser::result_t::ok;
+        };
+        esp.reset();
+        count();
+        esp.get_version();
+        count();
+        esp.set_mode(3);
+        count();
+        esp.set_mux_mode(0);
+        count();
+        esp.list_ap_raw();
+        count();
+        esp.join_ap("87654321", "87654321");
+        count();
+        // The reply is only valid until the next command.
+        bool found = esp.get_ip().find("192.168.1.23") != std::string::npos;
+        count();
+        esp.get_connection_status();
+        count();
+        std::printf("  esp8266:           %.2f s, %d of 8 replies with OK, "
+                    "IP %s\n",
+                    (sim.now_us() - start_us) / 1e6, n_ok,
+                    found ? "found" : "missing");
+        return found && n_ok == 8;
+    }
+
+    /**
+     * @brief The bring-up of main.cpp, polled every 100 ms. It also sets the
+     * scan options and raises the baud rate, so it sends more commands.
+     */
+    bool wifi_bring_up(esp8266& esp)
+    {
+        constexpr esp8266_credential networks[]{{"87654321", "87654321"}};
+        esp8266_wifi wifi{esp, networks, 921600};
+        uint64_t start_us = sim.now_us();
+        wifi.start();
+        while (wifi.poll() == esp8266_wifi::status_t::connecting)
+            ThisThread::sleep_for(100ms);
+        std::printf("  esp8266_wifi:      %.2f s, IP %.*s\n",
+                    (sim.now_us() - start_us) / 1e6,
+                    static_cast<int>(wifi.ip().size()), wifi.ip().data());
+        return wifi.status() == esp8266_wifi::status_t::connected;
+    }
+} // namespace
+
+int main()
+{
+    std::printf("Bring-up on the default script:\n");
+    old_setup_wifi();
+    sim.reset();
+    esp8266 esp;
+    bool connected = new_setup_wifi(esp);
+    sim.reset();
+    esp.set_baud(esp8266::default_baud);
+    connected = wifi_bring_up(esp) && connected;
+    return connected ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+/**
+ * @file esp8266_test.cpp
+ * @author UnnamedOrange
+ * @brief Check the esp8266 driver and esp8266_wifi on the ESP8266 simulator.
+ * @remark Build in tomato-clock-classic with
+ * `g++ -std=c++17 -O2 -DESP8266_SIMULATOR=1 -I . -o esp8266_test
+ * tools/esp8266_test.cpp`. It exits with 1 if a check fails.
+ * @remark The times are simulated, i.e. what the hardware would take with
+ * the default script of the simulator.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include <cstdio>
+
+#include "esp8266/esp8266.hpp"
+#include "esp8266/esp8266_wifi.hpp"
+
+namespace
+{
+    auto& sim = esp8266_simulator::instance();
+    int n_failure;
+
+    void expect(bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            std::printf("  FAILED: %s\n", what);
+            n_failure++;
+        }
+    }
+
+    constexpr esp8266_credential networks[]{
+        {"PKU", "12345678"},
+        {"87654321", "87654321"},
+    };
+
+    /**
+     * @brief Restore the default script, with both sides at the default baud
+     * rate.
+     */
+    void reset(esp8266& esp)
+    {
+        sim.reset();
+        esp.set_baud(esp8266::default_baud);
+    }
+    /**
+     * @brief Poll every 100 ms, like the main loop, until the bring-up ends.
+     *
+     * @return double Simulated seconds it took.
+     */
+    double run(esp8266_wifi& wifi)
+    {
+        uint64_t start_us = sim.now_us();
+        wifi.start();
+        while (wifi.poll() == esp8266_wifi::status_t::connecting)
+            ThisThread::sleep_for(100ms);
+        return (sim.now_us() - start_us) / 1e6;
+    }
+
+    void bring_up(esp8266& esp)
+    {
+        reset(esp);
+        esp8266_wifi single{esp, "87654321", "87654321"};
+        double seconds = run(single);
+        std::printf("  one network: %.2f s\n", seconds);
+        expect(single.status() == esp8266_wifi::status_t::connected,
+               "one network connects");
+        expect(single.ip() == "192.168.1.23", "the IP address is parsed");
+        expect(seconds < 4.5, "one network connects within 4.5 s");
+
+        reset(esp);
+        esp8266_wifi scan{esp, networks, 921600};
+        seconds = run(scan);
+        std::printf("  scan at 921600 baud: %.2f s\n", seconds);
+        expect(scan.status() == esp8266_wifi::status_t::connected,
+               "a scanned network connects");
+        expect(scan.network() == &networks[1],
+               "the network in range is joined");
+        expect(esp.baud() == 921600, "the baud rate is raised");
+        expect(seconds < 7.5, "a scanned network connects within 7.5 s");
+    }
+
+    void join_failure(esp8266& esp)
+    {
+        reset(esp);
+        sim.on("AT+CWJAP=", {{1000000, "+CWJAP:1\r\n\r\nFAIL\r\n"}});
+        esp8266_wifi wifi{esp, "87654321", "87654321"};
+        run(wifi);
+        expect(wifi.status() == esp8266_wifi::status_t::failed,
+               "FAIL from AT+CWJAP fails");
+
+        sim.on("AT+CWJAP=", {{1000000, "WIFI CONNECTED\r\n"},
+                             {1000, "\r\nOK\r\n"}});
+        uint64_t failed_us = sim.now_us();
+        while (wifi.poll() != esp8266_wifi::status_t::connected &&
+               sim.now_us() - failed_us < 30000000)
+            ThisThread::sleep_for(100ms);
+        double seconds = (sim.now_us() - failed_us) / 1e6;
+        std::printf("  retried and connected after %.2f s\n", seconds);
+        expect(wifi.status() == esp8266_wifi::status_t::connected,
+               "a retry connects");
+        expect(seconds >= 10, "the retry waits for retry_interval");
+    }
+
+    void baud_fallback(esp8266& esp)
+    {
+        reset(esp);
+        sim.set_max_baud(460800);
+        esp8266_wifi wifi{esp, "87654321", "87654321", 921600};
+        double seconds = run(wifi);
+        std::printf("  fell back in %.2f s, %d baud\n", seconds, esp.baud());
+        expect(wifi.status() == esp8266_wifi::status_t::connected,
+               "it connects after falling back");
+        expect(esp.baud() == esp8266::default_baud &&
+                   int(sim.baud()) == esp.baud(),
+               "both sides are back at the default baud rate");
+    }
+
+    void fragments(esp8266& esp)
+    {
+        reset(esp);
+        sim.set_fragment(20, 3000);
+        auto reply = esp.get_version();
+        expect(esp.last_result() == esp8266_reply_parser::result_t::ok &&
+                   reply.find("SDK version") != reply.npos,
+               "a fragmented reply is complete");
+        esp8266_wifi wifi{esp, "87654321", "87654321"};
+        run(wifi);
+        expect(wifi.status() == esp8266_wifi::status_t::connected &&
+                   wifi.ip() == "192.168.1.23",
+               "it connects with fragmented replies");
+    }
+
+    /**
+     * @brief A reply that comes after its command timed out must not complete
+     * the next command.
+     */
+    void late_reply(esp8266& esp)
+    {
+        reset(esp);
+        sim.on("AT", {{300000, "\r\nOK\r\n"}});
+        sim.on("AT+GMR", {{50000, "\r\nERROR\r\n"}});
+        esp.write_and_get_reply("AT\r\n", 100ms);
+        expect(esp.last_result() == esp8266_reply_parser::result_t::timeout,
+               "a slow AT times out");
+        ThisThread::sleep_for(500ms); // The OK arrives.
+        esp.get_version();
+        expect(esp.last_result() == esp8266_reply_parser::result_t::error,
+               "the late OK does not complete the next command");
+    }
+} // namespace
+
+int main()
+{
+    esp8266 esp;
+    std::printf("Bring-up:\n");
+    bring_up(esp);
+    std::printf("FAIL from AT+CWJAP:\n");
+    join_failure(esp);
+    std::printf("Baud rate fallback:\n");
+    baud_fallback(esp);
+    std::printf("Fragmented replies:\n");
+    fragments(esp);
+    std::printf("Late reply:\n");
+    late_reply(esp);
+    std::printf("%d failures.\n", n_failure);
+    return n_failure ? 1 : 0;
+}
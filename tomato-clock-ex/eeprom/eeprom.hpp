@@ -11,16 +11,22 @@
 
 #pragma once
 
+#if EEPROM_SIMULATOR
+#include "eeprom_sim.hpp"
+#else
 #include "mbed.h"
 
 #include "FlashIAPBlockDevice.h"
+#endif
 
+#include <algorithm>
 #include <array>
 #include <cstdint>
 #include <type_traits>
 #include <utility>
 
 #include "eeprom_default_config.hpp"
+#include "eeprom_record.hpp"
 
 namespace modules
 {
@@ -40,7 +46,8 @@ namespace modules
          */
         eeprom_device()
             : block_device_t{
-                  reinterpret_cast<uint32_t>(INTERNAL_FLASH_BASE_ADDRESS),
+                  static_cast<uint32_t>(reinterpret_cast<uintptr_t>(
+                      INTERNAL_FLASH_BASE_ADDRESS)),
                   static_cast<uint32_t>(INTERNAL_FLASH_SIZE)}
         {
             block_device_t::init();
@@ -51,17 +58,80 @@ namespace modules
         }
 
     public:
-        using block_device_t::erase;
         using block_device_t::get_erase_size;
         using block_device_t::get_program_size;
         using block_device_t::get_read_size;
-        using block_device_t::program;
+
+    public:
+        /**
+         * @brief Time spent in erase() and program(). The internal flash of
+         * STM32F401 has one bank, so the CPU cannot fetch code from the
+         * flash during that time, i.e. it is a stall of the whole system.
+         */
+        struct stats_t
+        {
+            uint32_t n_erase;
+            uint32_t n_program;
+            uint32_t max_erase_us;
+            uint32_t max_program_us;
+            uint32_t total_us;
+        };
+        static stats_t stats()
+        {
+            core_util_critical_section_enter();
+            stats_t ret = _stats;
+            core_util_critical_section_exit();
+            return ret;
+        }
+
+        int erase(mbed::bd_addr_t address, mbed::bd_size_t size)
+        {
+            uint32_t start = us_ticker_read();
+            int ret = block_device_t::erase(address, size);
+            uint32_t us = us_ticker_read() - start;
+            core_util_critical_section_enter();
+            _stats.n_erase++;
+            _stats.max_erase_us = std::max(_stats.max_erase_us, us);
+            _stats.total_us += us;
+            core_util_critical_section_exit();
+            return ret;
+        }
+        int program(const void* buffer, mbed::bd_addr_t address,
+                    mbed::bd_size_t size)
+        {
+            uint32_t start = us_ticker_read();
+            int ret = block_device_t::program(buffer, address, size);
+            uint32_t us = us_ticker_read() - start;
+            core_util_critical_section_enter();
+            _stats.n_program++;
+            _stats.max_program_us = std::max(_stats.max_program_us, us);
+            _stats.total_us += us;
+            core_util_critical_section_exit();
+            return ret;
+        }
+
+    private:
+        static inline stats_t _stats{};
     };
 
+    /**
+     * @brief Get a pointer to data in EEPROM for reading.
+     * @remark The flash is programmed behind the compiler's back, so the
+     * constant initializer of a constexpr object must be hidden from the
+     * optimizer, or reads may be folded into the initial value.
+     */
+    template <typename T>
+    const T* eeprom_read_barrier(const T* address)
+    {
+        asm("" : "+r"(address));
+        return address;
+    }
+
     /**
      * @brief Data stored in EEPROM. You are supposed to define ONLY one object
      * and avoid writing to EEPROM too frequently. Use @b constexpr to define
-     * the object and define it as a @b global or a @b static variable.
+     * the object and define it as a @b global or a @b static variable with
+     * @b EEPROM_ARENA, so that it is placed in the reserved erase blocks.
      *
      * @tparam T Type of data.
      *
@@ -73,51 +143,32 @@ namespace modules
      *
      * @tparam erase_block_size Erase block size of the flash (EEPROM).
      * Please define @b EEPROM_ERASE_BLOCK_SIZE before including this header.
-     *
-     * @tparam padding_size Data is padded with some bytes to check whether
-     * the data is valid. padding_size is the number of bytes to use.
      */
     template <typename T,
               size_t read_block_size = INTERNAL_FLASH_READ_BLOCK_SIZE,
               size_t program_block_size = INTERNAL_FLASH_PROGRAM_BLOCK_SIZE,
-              size_t erase_block_size = INTERNAL_FLASH_ERASE_BLOCK_SIZE,
-              size_t padding_size = 8>
+              size_t erase_block_size = INTERNAL_FLASH_ERASE_BLOCK_SIZE>
     class eeprom
     {
     private:
         /**
-         * @brief Padded data type.
+         * @brief Data with a sequence number and a CRC.
          */
-        struct data_t
-        {
-            uint8_t prefix[padding_size];
-            T value;
-            uint8_t suffix[padding_size];
-            constexpr data_t() : prefix{}, value{}, suffix{}
-            {
-            }
-            constexpr data_t(const T& data) : value{data}
-            {
-                for (size_t i = 0; i < padding_size; ++i)
-                    prefix[i] = i;
-                for (size_t i = 0; i < padding_size; ++i)
-                    suffix[i] = i;
-            }
-        };
+        using data_t = eeprom_record<T>;
         /**
-         * @brief Padded data type aligned to program_block_size.
+         * @brief Data type aligned to program_block_size.
          * @remark program_block_size may be smaller than 4, so a max is needed.
          */
-        struct alignas(std::max(4u, program_block_size)) program_block_data_t
-            : public data_t
+        struct alignas(std::max<size_t>(4, program_block_size))
+            program_block_data_t : public data_t
         {
             using data_t::data_t;
         };
         /**
-         * @brief Padded data type aligned to erase_block_size.
+         * @brief Data type aligned to erase_block_size.
          */
-        struct alignas(std::max(4u, erase_block_size)) erase_block_data_t
-            : public data_t
+        struct alignas(std::max<size_t>(4, erase_block_size))
+            erase_block_data_t : public data_t
         {
             using data_t::data_t;
         } _data;
@@ -131,7 +182,8 @@ namespace modules
         {
             // Because this->data is not constexpr as for C++ grammar,
             // this assertion cannot be replaced with static_assert.
-            assert(IS_ADDRESS_IN_INTERNAL_FLASH(&_data));
+            // Outside the reserved region, the erase block may hold code.
+            assert(IS_OBJECT_IN_INTERNAL_EEPROM(&_data, sizeof(_data)));
         }
 
     public:
@@ -173,7 +225,7 @@ namespace modules
         const T& value() const
         {
             _check_address();
-            return _data.value;
+            return eeprom_read_barrier(&_data)->value;
         }
         /**
          * @brief Get the value of the data.
@@ -189,28 +241,26 @@ namespace modules
         /**
          * @brief Check if the data is valid.
          * The data is valid if you have written to EEPROM,
-         * or the converting constructor is used.
+         * or the converting constructor is used,
+         * and the write was not interrupted.
          */
         bool valid() const
         {
-            for (size_t i = 0; i < padding_size; ++i)
-                if (_data.prefix[i] != i)
-                    return false;
-            for (size_t i = 0; i < padding_size; ++i)
-                if (_data.suffix[i] != i)
-                    return false;
-            return true;
+            return eeprom_read_barrier(&_data)->valid();
         }
         /**
          * @brief Write the data to EEPROM.
          * This takes a long time and consumes the life of EEPROM.
+         * @remark A reset between the erase and the program loses the value.
+         * Use eeprom_ab<T> if that is not acceptable.
          */
         void write(const T& value) const
         {
             _check_address();
             eeprom_device device;
             // Only store program_block_data_t to avoid stack overflow.
-            auto data = program_block_data_t{value};
+            auto data = program_block_data_t{
+                eeprom_read_barrier(&_data)->next_sequence(), value};
             // Block should be erased before programming.
             device.erase(reinterpret_cast<mbed::bd_addr_t>(
                              VIRTUAL_ADDRESS_TO_PHYCICAL_ADDRESS(&_data)),
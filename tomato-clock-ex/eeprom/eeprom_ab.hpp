@@ -0,0 +1,186 @@
+/**
+ * @file eeprom_ab.hpp
+ * @author UnnamedOrange
+ * @brief Data stored in two erase blocks of internal EEPROM, so that a write
+ * never destroys the last good copy.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstring>
+
+#include "eeprom.hpp"
+
+namespace modules
+{
+    /**
+     * @brief Data stored in EEPROM with an A/B pair of erase blocks. It is
+     * used like eeprom<T>.
+     *
+     * @remark eeprom<T> erases its only copy before programming the new one,
+     * so a reset in between loses the value. Here each write goes to the
+     * block holding the older copy, so the newer copy is only erased after
+     * its successor has been programmed and read back.
+     * @remark The sequence number of eeprom_record is the generation. The
+     * valid copy with the newer generation is the value, so a torn write
+     * leaves the previous value visible and nothing has to be repaired at
+     * boot.
+     *
+     * @tparam T Type of data.
+     * @tparam read_block_size Read block size of the flash (EEPROM).
+     * @tparam program_block_size Program block size of the flash (EEPROM).
+     * @tparam erase_block_size Erase block size of the flash (EEPROM).
+     */
+    template <typename T,
+              size_t read_block_size = INTERNAL_FLASH_READ_BLOCK_SIZE,
+              size_t program_block_size = INTERNAL_FLASH_PROGRAM_BLOCK_SIZE,
+              size_t erase_block_size = INTERNAL_FLASH_ERASE_BLOCK_SIZE>
+    class eeprom_ab
+    {
+    private:
+        using data_t = eeprom_record<T>;
+        /**
+         * @brief Data type aligned to program_block_size.
+         * @remark program_block_size may be smaller than 4, so a max is needed.
+         */
+        struct alignas(std::max<size_t>(4, program_block_size))
+            program_block_data_t : public data_t
+        {
+            using data_t::data_t;
+        };
+        /**
+         * @brief Data type aligned to erase_block_size.
+         */
+        struct alignas(std::max<size_t>(4, erase_block_size))
+            erase_block_data_t : public data_t
+        {
+            using data_t::data_t;
+        } _copies[2];
+        static_assert(std::is_trivial<T>::value, "Type T must be trivial.");
+
+    private:
+        void _check_address() const
+        {
+            assert(IS_OBJECT_IN_INTERNAL_EEPROM(_copies, sizeof(_copies)));
+        }
+        const erase_block_data_t* _get_copies() const
+        {
+            return eeprom_read_barrier(_copies);
+        }
+        /**
+         * @brief Whether generation a is newer than b, allowing wrapping.
+         * The initial value (0) is older than any written copy.
+         */
+        static bool _newer(uint32_t a, uint32_t b)
+        {
+            if (!a || !b)
+                return a > b;
+            return static_cast<int32_t>(a - b) > 0;
+        }
+        /**
+         * @brief Index of the copy holding the value: the newer of the valid
+         * copies, or 0 if neither is valid.
+         */
+        size_t _current() const
+        {
+            const erase_block_data_t* copies = _get_copies();
+            bool valid[2] = {copies[0].valid(), copies[1].valid()};
+            if (valid[0] && valid[1])
+                return _newer(copies[1].sequence, copies[0].sequence);
+            return valid[1];
+        }
+        static mbed::bd_addr_t _physical_address(const void* address)
+        {
+            return reinterpret_cast<mbed::bd_addr_t>(
+                VIRTUAL_ADDRESS_TO_PHYCICAL_ADDRESS(address));
+        }
+
+    public:
+        /**
+         * @brief Default constructor does not make the data valid.
+         * @see valid()
+         */
+        constexpr eeprom_ab() : _copies{}
+        {
+        }
+        /**
+         * @brief Initialize the data with the given value.
+         * This constructor makes the data valid.
+         * @see valid()
+         */
+        constexpr eeprom_ab(const T& initial_value)
+        {
+            _copies[0] = erase_block_data_t{initial_value};
+            _copies[1] = erase_block_data_t{};
+        }
+
+    public:
+        /**
+         * @brief Get the value of the data.
+         *
+         * @return const T& Value of the data. Note that it is unwriteable.
+         */
+        const T& value() const
+        {
+            _check_address();
+            return _get_copies()[_current()].value;
+        }
+        /**
+         * @brief Get the value of the data.
+         *
+         * @return const T& Value of the data. Note that it is unwriteable.
+         */
+        operator const T&() const
+        {
+            return value();
+        }
+
+    public:
+        /**
+         * @brief Check if the data is valid.
+         * The data is valid if you have written to EEPROM,
+         * or the converting constructor is used.
+         */
+        bool valid() const
+        {
+            return _get_copies()[_current()].valid();
+        }
+        /**
+         * @brief Write the data to the block of the older copy.
+         *
+         * @return bool Whether the new copy is read back correctly. If not,
+         * the previous value is kept.
+         */
+        bool write(const T& value) const
+        {
+            _check_address();
+            eeprom_device device;
+            size_t current = _current();
+            const erase_block_data_t& old = _get_copies()[current];
+            size_t target = old.valid() ? current ^ 1 : current;
+            auto data = program_block_data_t{
+                old.valid() ? old.next_sequence() : 1, value};
+
+            device.erase(_physical_address(&_copies[target]),
+                         sizeof(_copies[target]));
+            device.program(&data, _physical_address(&_copies[target]),
+                           sizeof(data));
+            // The CRC covers the record, so a bad program is never used.
+            const data_t& written = _get_copies()[target];
+            return written.valid() &&
+                   !std::memcmp(&written, &data, sizeof(data_t));
+        }
+        /**
+         * @brief Write the data to EEPROM.
+         * @see write()
+         */
+        const eeprom_ab& operator=(const T& value) const
+        {
+            write(value);
+            return *this;
+        }
+    };
+} // namespace modules
@@ -0,0 +1,146 @@
+/**
+ * @file eeprom_blocks.hpp
+ * @author UnnamedOrange
+ * @brief Erase blocks taken in turn by eeprom_kv and eeprom_session_history,
+ * which may share them.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <initializer_list>
+
+#include "eeprom.hpp"
+
+namespace modules
+{
+    /**
+     * @brief Three erase blocks shared by one eeprom_kv and one
+     * eeprom_session_history, which take two blocks each on their own. Use
+     * @b constexpr to define the object and define it as a @b global variable
+     * with @b EEPROM_ARENA, so that it is placed in the reserved erase blocks.
+     *
+     * @remark Each store keeps its newest block, and the third one is spare.
+     * A store whose block is full takes the spare block, and its old block
+     * becomes the spare. The older sessions of eeprom_session_history are
+     * thus kept only until eeprom_kv compacts.
+     */
+    struct eeprom_shared_area
+    {
+        alignas(std::max<size_t>(4, INTERNAL_FLASH_ERASE_BLOCK_SIZE))
+            uint8_t sectors[3][INTERNAL_FLASH_ERASE_BLOCK_SIZE];
+        constexpr eeprom_shared_area() : sectors{}
+        {
+        }
+    };
+
+    /**
+     * @brief Header at the start of an erase block of a store.
+     *
+     * @remark A torn header either has a wrong magic or a generation with
+     * more bits at 1 than intended, i.e. a greater one. So every store judges
+     * a header the same way, and the generations never go back.
+     */
+    struct eeprom_block_header
+    {
+        uint32_t magic;
+        uint32_t generation;
+
+        bool valid(uint32_t expected_magic) const
+        {
+            return magic == expected_magic && generation != 0xFFFFFFFF;
+        }
+    };
+
+    /**
+     * @brief Erase blocks of a store, identified by the magic in the headers
+     * of its blocks.
+     */
+    class eeprom_blocks
+    {
+    public:
+        static constexpr size_t npos = static_cast<size_t>(-1);
+        // Magics of the stores that may share blocks.
+        static constexpr uint32_t kv_magic = 0x3253564B;      // "KVS2"
+        static constexpr uint32_t history_magic = 0x33534854; // "THS3"
+
+    private:
+        using block_t = uint8_t[INTERNAL_FLASH_ERASE_BLOCK_SIZE];
+        const block_t* _blocks;
+        size_t _n_block;
+        uint32_t _magic;
+
+    public:
+        template <size_t n>
+        eeprom_blocks(const block_t (&blocks)[n], uint32_t magic)
+            : _blocks{blocks}, _n_block{n}, _magic{magic}
+        {
+            assert(IS_OBJECT_IN_INTERNAL_EEPROM(blocks, sizeof(blocks)));
+        }
+
+    public:
+        const uint8_t* operator[](size_t index) const
+        {
+            return eeprom_read_barrier(_blocks[index]);
+        }
+        mbed::bd_addr_t address(size_t index, size_t offset = 0) const
+        {
+            return reinterpret_cast<mbed::bd_addr_t>(
+                VIRTUAL_ADDRESS_TO_PHYCICAL_ADDRESS(_blocks[index] + offset));
+        }
+        eeprom_block_header header(size_t index) const
+        {
+            eeprom_block_header header;
+            std::memcpy(&header, (*this)[index], sizeof(header));
+            return header;
+        }
+        /**
+         * @brief Find the valid block with the greatest generation below a
+         * bound.
+         *
+         * @return size_t Index of the block, or npos if there is none.
+         */
+        size_t newest(uint32_t magic, uint32_t below = 0xFFFFFFFF) const
+        {
+            size_t ret = npos;
+            uint32_t generation{};
+            for (size_t i = 0; i < _n_block; ++i)
+            {
+                eeprom_block_header h = header(i);
+                if (!h.valid(magic) || h.generation >= below)
+                    continue;
+                if (ret == npos || h.generation > generation)
+                {
+                    ret = i;
+                    generation = h.generation;
+                }
+            }
+            return ret;
+        }
+        size_t newest() const
+        {
+            return newest(_magic);
+        }
+        /**
+         * @brief Find a block to erase, which is neither the active one nor
+         * the newest block of another store.
+         */
+        size_t spare(size_t active) const
+        {
+            for (size_t i = 0; i < _n_block; ++i)
+            {
+                bool busy = i == active;
+                for (uint32_t magic : {kv_magic, history_magic})
+                    busy = busy || (magic != _magic && newest(magic) == i);
+                if (!busy)
+                    return i;
+            }
+            // Blocks are shared by more stores than they can hold.
+            assert(false);
+            return npos;
+        }
+    };
+} // namespace modules
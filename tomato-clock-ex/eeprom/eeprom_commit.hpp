@@ -0,0 +1,266 @@
+/**
+ * @file eeprom_commit.hpp
+ * @author UnnamedOrange
+ * @brief Keep persisted values in RAM and write them to EEPROM lazily.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstring>
+
+#include "eeprom.hpp"
+
+namespace modules
+{
+    /**
+     * @brief Decide when RAM-shadowed values are written to EEPROM, so that a
+     * burst of changes (e.g. holding a button) costs one write.
+     *
+     * @remark Dirty values are committed together when one of these happens:
+     * @remark - Nothing has changed for policy_t::debounce.
+     * @remark - The oldest unsaved change is policy_t::max_delay old.
+     * @remark - poll() is told that the UI is idle, and nothing has changed
+     * for policy_t::idle_quiet.
+     * @remark - flush() is called, e.g. before sleeping or shutting down.
+     * @remark Not thread-safe. Call everything from the same thread.
+     */
+    class eeprom_commit_scheduler
+    {
+    public:
+        using clock = rtos::Kernel::Clock;
+
+        struct policy_t
+        {
+            clock::duration debounce = 3s;
+            clock::duration max_delay = 60s;
+            clock::duration idle_quiet = 500ms;
+        };
+        struct stats_t
+        {
+            uint32_t changes; // Changes of values.
+            uint32_t commits; // Writes to EEPROM.
+            /**
+             * @brief Number of writes saved compared with writing on every
+             * change.
+             */
+            uint32_t avoided() const
+            {
+                return changes - commits;
+            }
+        };
+
+        /**
+         * @brief Base of values managed by the scheduler.
+         */
+        class item
+        {
+            friend class eeprom_commit_scheduler;
+
+        private:
+            eeprom_commit_scheduler& _scheduler;
+            item* _next{};
+            bool _dirty{};
+
+        protected:
+            item(eeprom_commit_scheduler& scheduler) : _scheduler{scheduler}
+            {
+                _next = _scheduler._items;
+                _scheduler._items = this;
+            }
+            ~item()
+            {
+                for (item** p = &_scheduler._items; *p; p = &(*p)->_next)
+                    if (*p == this)
+                    {
+                        *p = _next;
+                        break;
+                    }
+            }
+            item(const item&) = delete;
+            item& operator=(const item&) = delete;
+
+            /**
+             * @brief Called by a derived class when its value changes.
+             */
+            void _mark_dirty()
+            {
+                _dirty = true;
+                _scheduler._on_change();
+            }
+            /**
+             * @brief Write the value to EEPROM.
+             *
+             * @return bool Whether anything was written.
+             */
+            virtual bool _commit() = 0;
+
+        public:
+            bool dirty() const
+            {
+                return _dirty;
+            }
+        };
+
+    private:
+        policy_t _policy;
+        item* _items{};
+        bool _dirty{};
+        clock::time_point _first_change{};
+        clock::time_point _last_change{};
+        stats_t _stats{};
+
+        void _on_change()
+        {
+            auto now = clock::now();
+            if (!_dirty)
+                _first_change = now;
+            _last_change = now;
+            _dirty = true;
+            _stats.changes++;
+        }
+
+    public:
+        eeprom_commit_scheduler() = default;
+        explicit eeprom_commit_scheduler(const policy_t& policy)
+            : _policy{policy}
+        {
+        }
+
+    public:
+        /**
+         * @brief Commit dirty values if the policy says so. Call it
+         * periodically, e.g. from the main loop.
+         *
+         * @param idle Whether the UI is idle now, e.g. no key is held and no
+         * menu is open.
+         * @return bool Whether values were committed.
+         */
+        bool poll(bool idle = false)
+        {
+            if (!_dirty)
+                return false;
+            auto now = clock::now();
+            bool due = now - _last_change >= _policy.debounce ||
+                       now - _first_change >= _policy.max_delay ||
+                       (idle && now - _last_change >= _policy.idle_quiet);
+            if (due)
+                flush();
+            return due;
+        }
+        /**
+         * @brief Commit all dirty values now. Call it before sleeping or
+         * shutting down.
+         */
+        void flush()
+        {
+            for (item* p = _items; p; p = p->_next)
+            {
+                if (!p->_dirty)
+                    continue;
+                if (p->_commit())
+                    _stats.commits++;
+                p->_dirty = false;
+            }
+            _dirty = false;
+        }
+        /**
+         * @brief Whether any value has not been written yet.
+         */
+        bool dirty() const
+        {
+            return _dirty;
+        }
+        /**
+         * @brief Time until poll() commits without being idle, or zero if
+         * nothing is dirty.
+         */
+        clock::duration time_to_commit() const
+        {
+            if (!_dirty)
+                return clock::duration::zero();
+            auto deadline = std::min(_last_change + _policy.debounce,
+                                     _first_change + _policy.max_delay);
+            return std::max(deadline - clock::now(), clock::duration::zero());
+        }
+        stats_t stats() const
+        {
+            return _stats;
+        }
+    };
+
+    /**
+     * @brief A value kept in RAM and written to an EEPROM store by an
+     * eeprom_commit_scheduler.
+     *
+     * @tparam store_t eeprom<T> or eeprom_log<T>, or any type with value(),
+     * valid() and write().
+     */
+    template <typename store_t>
+    class eeprom_persistent final : public eeprom_commit_scheduler::item
+    {
+    public:
+        using value_type =
+            std::decay_t<decltype(std::declval<const store_t&>().value())>;
+
+    private:
+        const store_t& _store;
+        value_type _value;
+
+    public:
+        /**
+         * @param default_value Used if the store is not valid.
+         * @remark Unsaved changes are lost when the object is destroyed,
+         * unless eeprom_commit_scheduler::flush() is called.
+         */
+        eeprom_persistent(eeprom_commit_scheduler& scheduler,
+                          const store_t& store,
+                          const value_type& default_value = {})
+            : item{scheduler}, _store{store},
+              _value{store.valid() ? store.value() : default_value}
+        {
+        }
+
+    public:
+        const value_type& value() const
+        {
+            return _value;
+        }
+        operator const value_type&() const
+        {
+            return value();
+        }
+        /**
+         * @brief Change the value in RAM. It is written later by the
+         * scheduler.
+         */
+        void set(const value_type& value)
+        {
+            if (!std::memcmp(&_value, &value, sizeof(value_type)))
+                return;
+            _value = value;
+            _mark_dirty();
+        }
+        eeprom_persistent& operator=(const value_type& value)
+        {
+            set(value);
+            return *this;
+        }
+
+    private:
+        /**
+         * @brief A value changed back to what is stored is not written.
+         */
+        bool _commit() override
+        {
+            if (_store.valid() &&
+                !std::memcmp(&_store.value(), &_value, sizeof(value_type)))
+                return false;
+            _store.write(_value);
+            return true;
+        }
+    };
+} // namespace modules
@@ -8,6 +8,9 @@
  * @remark - INTERNAL_FLASH_READ_BLOCK_SIZE
  * @remark - INTERNAL_FLASH_PROGRAM_BLOCK_SIZE
  * @remark - INTERNAL_FLASH_ERASE_BLOCK_SIZE
+ * @remark - INTERNAL_EEPROM_OFFSET
+ * @remark - INTERNAL_EEPROM_SIZE
+ * @remark - EEPROM_ARENA
  *
  * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
  * See the LICENSE file in the repository root for full license text.
@@ -43,6 +46,33 @@
 #define INTERNAL_FLASH_ERASE_BLOCK_SIZE ((size_t)16384)
 #endif
 
+/**
+ * @brief Region of internal flash reserved for EEPROM objects, as an offset
+ * from INTERNAL_FLASH_BASE_ADDRESS. Sectors 1 to 3 of STM32F401RE by default,
+ * the only sectors of INTERNAL_FLASH_ERASE_BLOCK_SIZE that do not hold the
+ * vector table. It must match the linker script.
+ * @remark The three blocks are a tight budget: eeprom_kv_area and
+ * eeprom_history_area take two blocks each, so they do not fit together. Use
+ * one eeprom_shared_area for both stores instead.
+ */
+
+#ifndef INTERNAL_EEPROM_OFFSET
+#define INTERNAL_EEPROM_OFFSET ((size_t)0x4000)
+#endif
+
+#ifndef INTERNAL_EEPROM_SIZE
+#define INTERNAL_EEPROM_SIZE ((size_t)0xC000)
+#endif
+
+/**
+ * @brief Attribute to place an EEPROM object in the reserved region, e.g.
+ * `EEPROM_ARENA constexpr eeprom<int> value{0};`. Objects are packed without
+ * gaps, and the linker fails if they do not fit.
+ */
+#ifndef EEPROM_ARENA
+#define EEPROM_ARENA __attribute__((section(".eeprom_arena"), used))
+#endif
+
 /**
  * @brief Utils for checking the address.
  */
@@ -51,6 +81,13 @@
 #define IS_ADDRESS_IN_INTERNAL_FLASH(address)                                  \
     ((void*)INTERNAL_FLASH_BASE_ADDRESS <= (address) &&                        \
      (address) < INTERNAL_FLASH_END_ADDRESS)
+#define INTERNAL_EEPROM_BASE_ADDRESS                                           \
+    ((void*)((size_t)INTERNAL_FLASH_BASE_ADDRESS + INTERNAL_EEPROM_OFFSET))
+#define INTERNAL_EEPROM_END_ADDRESS                                            \
+    ((void*)((size_t)INTERNAL_EEPROM_BASE_ADDRESS + INTERNAL_EEPROM_SIZE))
+#define IS_OBJECT_IN_INTERNAL_EEPROM(address, size)                            \
+    ((size_t)INTERNAL_EEPROM_BASE_ADDRESS <= (size_t)(address) &&              \
+     (size_t)(address) + (size) <= (size_t)INTERNAL_EEPROM_END_ADDRESS)
 
 /**
  * @brief Utils for converting the address.
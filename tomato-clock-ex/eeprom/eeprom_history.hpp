@@ -0,0 +1,394 @@
+/**
+ * @file eeprom_history.hpp
+ * @author UnnamedOrange
+ * @brief Ring of completed work and rest sessions in internal EEPROM.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstring>
+#include <ctime>
+
+#include "eeprom.hpp"
+#include "eeprom_blocks.hpp"
+
+namespace modules
+{
+    /**
+     * @brief Two erase blocks reserved for eeprom_session_history. Use
+     * @b constexpr to define the object and define it as a @b global variable
+     * with @b EEPROM_ARENA, so that it is placed in the reserved erase blocks.
+     */
+    struct eeprom_history_area
+    {
+        alignas(std::max<size_t>(4, INTERNAL_FLASH_ERASE_BLOCK_SIZE))
+            uint8_t sectors[2][INTERNAL_FLASH_ERASE_BLOCK_SIZE];
+        constexpr eeprom_history_area() : sectors{}
+        {
+        }
+    };
+
+    /**
+     * @brief A finished session.
+     */
+    struct eeprom_session
+    {
+        enum class kind_t : uint8_t
+        {
+            work,
+            rest,
+        };
+        /**
+         * @brief How the session ended, compared with its planned time.
+         */
+        enum class end_t : uint8_t
+        {
+            on_time,
+            early, // Ended by the user before the time was up.
+            late,  // Ran over the time.
+        };
+        time_t start;      // Rounded down to minutes when stored.
+        uint32_t duration; // In seconds. At most max_duration is stored.
+        kind_t kind;
+        end_t end;
+
+        static constexpr uint32_t max_duration = (1u << 13) - 1;
+    };
+
+    /**
+     * @brief History of sessions in EEPROM, with daily and weekly statistics
+     * kept in RAM.
+     *
+     * @remark Each session is one 32-bit word holding the minutes since the
+     * previous session, so append() programs 4 bytes and never erases until
+     * an erase block is full. Then a spare block is erased and the ring
+     * continues there, keeping at least one block (about 4000 sessions) of
+     * history. With eeprom_history_area, the spare is the older block. With
+     * eeprom_shared_area, the older block is kept until eeprom_kv takes it.
+     * @remark Each word holds the number of 0 bits in the rest of it. A
+     * write torn by a reset only leaves bits at 1, which always breaks the
+     * count, so torn words and free space (all 1s) are never taken as
+     * entries. If the gap from the previous session does not fit, an anchor
+     * word with the absolute time is written first.
+     * @remark The flash is scanned once by the constructor. After that,
+     * statistics are read from RAM and updated by append().
+     * @remark Times are in the time zone of the RTC, so that days begin at
+     * local midnight if the RTC is set to local time.
+     */
+    class eeprom_session_history
+    {
+    public:
+        static constexpr size_t n_day = 7; // Days kept in the statistics.
+
+        struct day_stats_t
+        {
+            int32_t day{}; // Days since the epoch.
+            uint16_t n_work{};
+            uint16_t n_rest{};
+            uint16_t n_early{};      // Work sessions ended early.
+            uint16_t n_late{};       // Work sessions that ran over.
+            uint32_t work_seconds{}; // Sum of durations of work sessions.
+        };
+
+    private:
+        static constexpr size_t erase_block_size =
+            INTERNAL_FLASH_ERASE_BLOCK_SIZE;
+        static constexpr uint32_t magic = eeprom_blocks::history_magic;
+        static constexpr uint32_t free_word = 0xFFFFFFFF;
+
+        using sector_header_t = eeprom_block_header;
+        static constexpr size_t n_word =
+            (erase_block_size - sizeof(sector_header_t)) / 4;
+
+        // Layout of a word, from the most significant bit:
+        // [check:5][anchor:1][payload:26]
+        // Session payload: [delta minutes:10][duration:13][kind:1][end:2]
+        // Anchor payload: [minutes since the epoch:26], until 2097
+        static constexpr uint32_t payload_mask = (1u << 26) - 1;
+        static constexpr uint32_t anchor_bit = 1u << 26;
+        static constexpr uint32_t max_delta = (1u << 10) - 1;
+
+        /**
+         * @brief Number of 0 bits of the anchor bit and the payload.
+         */
+        static uint32_t _check(uint32_t data)
+        {
+            return 27 - __builtin_popcount(data);
+        }
+        static uint32_t _encode(uint32_t data)
+        {
+            return _check(data) << 27 | data;
+        }
+        static bool _decode(uint32_t word, uint32_t& data)
+        {
+            data = word & (anchor_bit | payload_mask);
+            return word >> 27 == _check(data);
+        }
+
+        /**
+         * @brief State of decoding a block.
+         */
+        struct cursor_t
+        {
+            uint32_t last_minutes; // Start of the latest session.
+            bool has_last;         // Whether last_minutes is known.
+        };
+
+    private:
+        eeprom_blocks _blocks;
+        static constexpr size_t npos = eeprom_blocks::npos;
+        size_t _active = npos;
+        uint32_t _generation{};
+        size_t _n_used{}; // Words used in the active block.
+        cursor_t _cursor{};
+        size_t _older = npos; // Block of the older sessions.
+        uint32_t _n_older{};  // Sessions in the older block.
+        uint32_t _n_active{}; // Sessions in the active block.
+        std::array<day_stats_t, n_day> _days{};
+
+    private:
+        uint32_t _word(size_t sector, size_t index) const
+        {
+            uint32_t word;
+            std::memcpy(&word,
+                        _blocks[sector] + sizeof(sector_header_t) + index * 4,
+                        sizeof(word));
+            return word;
+        }
+        /**
+         * @brief Whether the older block still holds the older sessions. It
+         * may have been taken by another store.
+         */
+        bool _has_older() const
+        {
+            if (_older == npos)
+                return false;
+            sector_header_t header = _blocks.header(_older);
+            return header.valid(magic) && header.generation < _generation;
+        }
+
+        /**
+         * @brief Visit the sessions of a block in order.
+         *
+         * @return size_t Number of words used in the block.
+         */
+        template <typename callback_t>
+        size_t _scan(size_t sector, cursor_t& cursor,
+                     callback_t&& callback) const
+        {
+            cursor = cursor_t{};
+            size_t i = 0;
+            for (; i < n_word; ++i)
+            {
+                uint32_t word = _word(sector, i);
+                uint32_t data;
+                if (word == free_word)
+                    break;
+                if (!_decode(word, data))
+                    continue; // Torn by a reset.
+                if (data & anchor_bit)
+                {
+                    cursor = cursor_t{data & payload_mask, true};
+                    continue;
+                }
+                // The anchor of the block is torn.
+                if (!cursor.has_last)
+                    continue;
+                eeprom_session session;
+                cursor.last_minutes += data >> 16 & max_delta;
+                session.start = time_t(cursor.last_minutes) * 60;
+                session.duration = data >> 3 & eeprom_session::max_duration;
+                session.kind = eeprom_session::kind_t(data >> 2 & 1);
+                session.end = eeprom_session::end_t(data & 3);
+                callback(session);
+            }
+            return i;
+        }
+        /**
+         * @brief Index the older and the active block, in this order.
+         */
+        void _load()
+        {
+            _active = _blocks.newest();
+            if (_active == npos)
+                return;
+            _generation = _blocks.header(_active).generation;
+            _older = _blocks.newest(magic, _generation);
+
+            // Each block begins with an anchor, so the blocks are decoded
+            // independently.
+            if (_older != npos)
+                _scan(_older, _cursor, [this](const eeprom_session& session) {
+                    _n_older++;
+                    _account(session);
+                });
+            _n_used =
+                _scan(_active, _cursor, [this](const eeprom_session& session) {
+                    _n_active++;
+                    _account(session);
+                });
+        }
+        void _account(const eeprom_session& session)
+        {
+            int32_t day = day_of(session.start);
+            day_stats_t& stats = _days[size_t(day) % n_day];
+            if (stats.day != day)
+            {
+                if (stats.day > day && (stats.n_work || stats.n_rest))
+                    return; // Older than the days kept.
+                stats = day_stats_t{day};
+            }
+            if (session.kind == eeprom_session::kind_t::work)
+            {
+                stats.n_work++;
+                stats.n_early += session.end == eeprom_session::end_t::early;
+                stats.n_late += session.end == eeprom_session::end_t::late;
+                stats.work_seconds += session.duration;
+            }
+            else
+                stats.n_rest++;
+        }
+        void _program_word(eeprom_device& device, uint32_t word)
+        {
+            device.program(
+                &word,
+                _blocks.address(_active,
+                                sizeof(sector_header_t) + _n_used * 4),
+                sizeof(word));
+            _n_used++;
+        }
+        /**
+         * @brief Make sure n words can be appended. This may erase a spare
+         * block, which may be the older block.
+         */
+        void _reserve(eeprom_device& device, size_t n)
+        {
+            if (_active != npos && _n_used + n <= n_word)
+                return;
+            size_t next = _blocks.spare(_active);
+            device.erase(_blocks.address(next), erase_block_size);
+            sector_header_t header{magic, _generation + 1};
+            device.program(&header, _blocks.address(next), sizeof(header));
+            _older = _active;
+            _n_older = _n_active;
+            _n_active = 0;
+            _active = next;
+            _generation++;
+            _n_used = 0;
+            _cursor = cursor_t{};
+        }
+
+    public:
+        /**
+         * @brief Read the history and build the statistics. The flash is not
+         * written until the first append().
+         */
+        explicit eeprom_session_history(const eeprom_history_area& area)
+            : _blocks{area.sectors, magic}
+        {
+            _load();
+        }
+        /**
+         * @brief Read the history in blocks shared with an eeprom_kv.
+         */
+        explicit eeprom_session_history(const eeprom_shared_area& area)
+            : _blocks{area.sectors, magic}
+        {
+            _load();
+        }
+
+    public:
+        /**
+         * @brief Days since the epoch of a time.
+         */
+        static int32_t day_of(time_t time)
+        {
+            return static_cast<int32_t>(time / 86400 -
+                                        (time % 86400 < 0 ? 1 : 0));
+        }
+        /**
+         * @brief Store a finished session and update the statistics.
+         * @remark Programs 4 bytes, or 8 if an anchor is needed. An erase
+         * block is erased about once every 4000 sessions.
+         */
+        void append(const eeprom_session& session)
+        {
+            uint32_t minutes = static_cast<uint32_t>(session.start / 60);
+            eeprom_device device;
+            bool anchor = !_cursor.has_last || minutes < _cursor.last_minutes ||
+                          minutes - _cursor.last_minutes > max_delta;
+            _reserve(device, anchor ? 2 : 1);
+            // _reserve() may start a new block, which needs an anchor.
+            if (anchor || !_cursor.has_last)
+            {
+                _program_word(device,
+                              _encode(anchor_bit | (minutes & payload_mask)));
+                _cursor = cursor_t{minutes, true};
+            }
+            uint32_t duration =
+                std::min(session.duration, eeprom_session::max_duration);
+            _program_word(device,
+                          _encode((minutes - _cursor.last_minutes) << 16 |
+                                  duration << 3 |
+                                  uint32_t(session.kind) << 2 |
+                                  uint32_t(session.end)));
+            _cursor.last_minutes = minutes;
+            _n_active++;
+            _account(session);
+        }
+        /**
+         * @brief Visit the stored sessions from the oldest to the newest.
+         * This scans the flash.
+         */
+        template <typename callback_t>
+        void for_each(callback_t&& callback) const
+        {
+            if (_active == npos)
+                return;
+            cursor_t cursor;
+            if (_has_older())
+                _scan(_older, cursor, callback);
+            _scan(_active, cursor, callback);
+        }
+
+    public:
+        /**
+         * @brief Number of sessions stored in the flash.
+         */
+        uint32_t size() const
+        {
+            return _n_active + (_has_older() ? _n_older : 0);
+        }
+        /**
+         * @brief Statistics of a day. Only the last n_day days that have
+         * sessions are kept.
+         */
+        day_stats_t day(int32_t day) const
+        {
+            const day_stats_t& stats = _days[size_t(day) % n_day];
+            return stats.day == day ? stats : day_stats_t{day};
+        }
+        /**
+         * @brief Sum of the statistics of the n_day days ending with today.
+         * The day of the result is today.
+         */
+        day_stats_t week(int32_t today) const
+        {
+            day_stats_t ret{today};
+            for (size_t i = 0; i < n_day; ++i)
+            {
+                day_stats_t stats = day(today - int32_t(i));
+                ret.n_work += stats.n_work;
+                ret.n_rest += stats.n_rest;
+                ret.n_early += stats.n_early;
+                ret.n_late += stats.n_late;
+                ret.work_seconds += stats.work_seconds;
+            }
+            return ret;
+        }
+    };
+} // namespace modules
@@ -0,0 +1,337 @@
+/**
+ * @file eeprom_kv.hpp
+ * @author UnnamedOrange
+ * @brief Store several typed values in erase blocks of internal EEPROM.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+
+#include "eeprom.hpp"
+#include "eeprom_blocks.hpp"
+
+namespace modules
+{
+    /**
+     * @brief Key of a value in eeprom_kv.
+     *
+     * @tparam key_id Unique ID of the key. It is stored in the flash, so do
+     * not reuse the ID of a removed key for a different type.
+     * @tparam T Type of the value. It must be trivial.
+     */
+    template <uint16_t key_id, typename T>
+    struct eeprom_key
+    {
+        static_assert(key_id != 0xFFFF, "0xFFFF marks free space.");
+        static_assert(std::is_trivial<T>::value, "Type T must be trivial.");
+        static constexpr uint16_t id = key_id;
+        using value_type = T;
+    };
+
+    /**
+     * @brief Two erase blocks reserved for eeprom_kv. Use @b constexpr to
+     * define the object and define it as a @b global variable with
+     * @b EEPROM_ARENA, so that it is placed in the reserved erase blocks.
+     */
+    struct eeprom_kv_area
+    {
+        alignas(std::max<size_t>(4, INTERNAL_FLASH_ERASE_BLOCK_SIZE))
+            uint8_t sectors[2][INTERNAL_FLASH_ERASE_BLOCK_SIZE];
+        constexpr eeprom_kv_area() : sectors{}
+        {
+        }
+    };
+
+    /**
+     * @brief Key-value store in EEPROM. Each write appends a tagged record
+     * to the active erase block. When the block is full, the latest record of
+     * each other key and the new record are written to a spare block, which
+     * then becomes active. So the block only needs to hold one record of each
+     * key.
+     *
+     * @remark The offsets of the latest records are indexed in RAM when the
+     * object is constructed, so reads are O(1) and never scan the flash.
+     * @remark The header of the new block is programmed after all records are
+     * copied, so a reset during compaction leaves the old block active.
+     * @remark Records of unknown keys and records that fail the CRC, such as
+     * one torn by a reset, are skipped and dropped by compaction.
+     *
+     * @tparam keys eeprom_key types. Their IDs must be unique.
+     */
+    template <typename... keys>
+    class eeprom_kv
+    {
+    private:
+        static constexpr size_t erase_block_size =
+            INTERNAL_FLASH_ERASE_BLOCK_SIZE;
+        // Records are aligned for any value, so get() can point into the
+        // flash even for uint64_t and double.
+        static constexpr size_t align_size = std::max<size_t>(
+            alignof(std::max_align_t), INTERNAL_FLASH_PROGRAM_BLOCK_SIZE);
+        static constexpr size_t n_key = sizeof...(keys);
+        static constexpr uint32_t magic = eeprom_blocks::kv_magic;
+
+        using sector_header_t = eeprom_block_header;
+        struct record_header_t
+        {
+            uint16_t id;   // 0xFFFF means the rest of the block is free.
+            uint16_t size; // Size of the value.
+            uint32_t crc;  // CRC-32 of id, size and the value.
+
+            uint32_t compute_crc(const void* value) const
+            {
+                return eeprom_crc32(value, size,
+                                    eeprom_crc32(this, offsetof(
+                                                           record_header_t,
+                                                           crc)));
+            }
+        };
+        static_assert(
+            (sizeof(sector_header_t) + sizeof(record_header_t)) %
+                    alignof(std::max_align_t) ==
+                0,
+            "Values must start at an aligned offset.");
+
+        static constexpr std::array<uint16_t, n_key> _ids{keys::id...};
+        static constexpr std::array<uint16_t, n_key> _sizes{
+            sizeof(typename keys::value_type)...};
+        static constexpr bool _unique_ids()
+        {
+            for (size_t i = 0; i < n_key; ++i)
+                for (size_t j = 0; j < i; ++j)
+                    if (_ids[i] == _ids[j])
+                        return false;
+            return true;
+        }
+        static_assert(_unique_ids(), "IDs of keys must be unique.");
+        static_assert(((alignof(typename keys::value_type) <= align_size) &&
+                       ...),
+                      "Over-aligned values are not supported.");
+        template <typename key>
+        static constexpr size_t _index_of()
+        {
+            constexpr bool matches[] = {std::is_same<key, keys>::value...};
+            for (size_t i = 0; i < n_key; ++i)
+                if (matches[i])
+                    return i;
+            return n_key;
+        }
+        static constexpr size_t _record_size(size_t value_size)
+        {
+            return (sizeof(record_header_t) + value_size + align_size - 1) /
+                   align_size * align_size;
+        }
+        static_assert(sizeof(sector_header_t) +
+                              (_record_size(sizeof(
+                                   typename keys::value_type)) +
+                               ...) <=
+                          erase_block_size,
+                      "The values do not fit in an erase block.");
+
+    private:
+        eeprom_blocks _blocks;
+        static constexpr size_t npos = eeprom_blocks::npos;
+        size_t _active = npos; // Index of the active block.
+        uint32_t _generation{};
+        size_t _write_offset{};
+        std::array<uint32_t, n_key> _index{}; // Offsets. 0 means no record.
+
+    private:
+        /**
+         * @brief Find the active block and index the latest record of each
+         * key. Only reads the flash.
+         */
+        void _load()
+        {
+            _active = _blocks.newest();
+            if (_active == npos)
+                return;
+            _generation = _blocks.header(_active).generation;
+
+            const uint8_t* sector = _blocks[_active];
+            size_t offset = sizeof(sector_header_t);
+            while (offset + sizeof(record_header_t) <= erase_block_size)
+            {
+                record_header_t header;
+                std::memcpy(&header, sector + offset, sizeof(header));
+                if (header.id == 0xFFFF)
+                    break;
+                size_t size = _record_size(header.size);
+                if (offset + size > erase_block_size)
+                {
+                    // The header is torn. Compact before the next write.
+                    offset = erase_block_size;
+                    break;
+                }
+                // A torn or corrupted record is skipped.
+                if (header.crc !=
+                    header.compute_crc(sector + offset + sizeof(header)))
+                {
+                    offset += size;
+                    continue;
+                }
+                for (size_t i = 0; i < n_key; ++i)
+                    if (_ids[i] == header.id && _sizes[i] == header.size)
+                        _index[i] = offset;
+                offset += size;
+            }
+            _write_offset = offset;
+        }
+        /**
+         * @brief Erase a block and start it with a header.
+         */
+        void _format(eeprom_device& device, size_t index, uint32_t generation)
+        {
+            device.erase(_blocks.address(index), erase_block_size);
+            sector_header_t header{magic, generation};
+            device.program(&header, _blocks.address(index), sizeof(header));
+        }
+        /**
+         * @brief Copy the latest records to a spare block and activate it.
+         * The record of one key is replaced by a new one, so that the block
+         * never has to hold both.
+         *
+         * @param key Index of the key of the new record.
+         * @param record The new record, in RAM.
+         */
+        void _compact(eeprom_device& device, size_t key, const uint8_t* record)
+        {
+            size_t spare = _blocks.spare(_active);
+            const uint8_t* from = _blocks[_active];
+            device.erase(_blocks.address(spare), erase_block_size);
+            size_t offset = sizeof(sector_header_t);
+            std::array<uint32_t, n_key> index{};
+            for (size_t i = 0; i < n_key; ++i)
+            {
+                size_t size = _record_size(_sizes[i]);
+                if (i == key)
+                {
+                    device.program(record, _blocks.address(spare, offset),
+                                   size);
+                    index[i] = offset;
+                    offset += size;
+                    continue;
+                }
+                if (!_index[i])
+                    continue;
+                // Copy through RAM in case the driver cannot program from
+                // the flash.
+                uint8_t buffer[64];
+                for (size_t copied = 0; copied < size;)
+                {
+                    size_t n = std::min(sizeof(buffer), size - copied);
+                    std::memcpy(buffer, from + _index[i] + copied, n);
+                    device.program(buffer,
+                                   _blocks.address(spare, offset + copied), n);
+                    copied += n;
+                }
+                index[i] = offset;
+                offset += size;
+            }
+            sector_header_t header{magic, _generation + 1};
+            device.program(&header, _blocks.address(spare), sizeof(header));
+            _active = spare;
+            _generation++;
+            _write_offset = offset;
+            _index = index;
+        }
+
+    public:
+        /**
+         * @brief Index the stored records. The flash is not written until the
+         * first set().
+         */
+        explicit eeprom_kv(const eeprom_kv_area& area)
+            : _blocks{area.sectors, magic}
+        {
+            _load();
+        }
+        /**
+         * @brief Index the stored records in blocks shared with an
+         * eeprom_session_history.
+         */
+        explicit eeprom_kv(const eeprom_shared_area& area)
+            : _blocks{area.sectors, magic}
+        {
+            _load();
+        }
+
+    public:
+        /**
+         * @brief Get the stored value of a key.
+         *
+         * @return const T* Pointer to the value in the flash, or nullptr if
+         * the key has never been written. It is invalidated by set().
+         */
+        template <typename key>
+        const typename key::value_type* get() const
+        {
+            constexpr size_t i = _index_of<key>();
+            static_assert(i < n_key, "The key is not registered.");
+            if (!_index[i])
+                return nullptr;
+            return reinterpret_cast<const typename key::value_type*>(
+                _blocks[_active] + _index[i] + sizeof(record_header_t));
+        }
+        /**
+         * @brief Get the stored value of a key, or default_value if the key
+         * has never been written.
+         */
+        template <typename key>
+        typename key::value_type value_or(
+            const typename key::value_type& default_value) const
+        {
+            auto value = get<key>();
+            return value ? *value : default_value;
+        }
+        /**
+         * @brief Store the value of a key. Nothing is written if the value is
+         * unchanged. This may erase a block.
+         */
+        template <typename key>
+        void set(const typename key::value_type& value)
+        {
+            using value_t = typename key::value_type;
+            constexpr size_t i = _index_of<key>();
+            static_assert(i < n_key, "The key is not registered.");
+            constexpr size_t size = _record_size(sizeof(value_t));
+
+            if (auto stored = get<key>();
+                stored && !std::memcmp(stored, &value, sizeof(value_t)))
+                return;
+
+            uint8_t record[size];
+            std::memset(record, 0xFF, size);
+            record_header_t header{key::id, sizeof(value_t), 0};
+            header.crc = header.compute_crc(&value);
+            std::memcpy(record, &header, sizeof(header));
+            std::memcpy(record + sizeof(header), &value, sizeof(value_t));
+
+            eeprom_device device;
+            if (_active == npos)
+            {
+                _active = _blocks.spare(npos);
+                _format(device, _active, 1);
+                _generation = 1;
+                _write_offset = sizeof(sector_header_t);
+            }
+            else if (_write_offset + size > erase_block_size)
+            {
+                // The new record takes the place of the old one, so the
+                // latest records of all keys always fit.
+                _compact(device, i, record);
+                return;
+            }
+
+            device.program(record, _blocks.address(_active, _write_offset),
+                           size);
+            _index[i] = _write_offset;
+            _write_offset += size;
+        }
+    };
+} // namespace modules
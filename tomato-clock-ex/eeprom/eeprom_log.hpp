@@ -0,0 +1,211 @@
+/**
+ * @file eeprom_log.hpp
+ * @author UnnamedOrange
+ * @brief Use internal EEPROM to store data in append-only (wear-leveled) mode.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include "eeprom.hpp"
+
+namespace modules
+{
+    /**
+     * @brief Data stored in EEPROM in append-only mode. It is used like
+     * eeprom<T>, but the erase block is divided into slots and every write
+     * programs the next free slot. The block is erased only when all slots
+     * are used, i.e. once every n_slot writes instead of on every write.
+     *
+     * @remark Slots are used from the first one, so the used slots are always
+     * before the free (erased) ones, and the next free slot is found by a
+     * binary search. The latest valid slot holds the value, and a slot torn
+     * by a reset fails its CRC and is skipped.
+     * @remark The slots after the initial value are not erased in the image,
+     * so the first write erases the block once.
+     * @remark When all slots are used, write() erases the only block and
+     * then programs the new value. A reset in between loses the value, so use
+     * eeprom_ab for values that must survive a power loss.
+     *
+     * @tparam T Type of data.
+     * @tparam read_block_size Read block size of the flash (EEPROM).
+     * @tparam program_block_size Program block size of the flash (EEPROM).
+     * Each slot is aligned to it.
+     * @tparam erase_block_size Erase block size of the flash (EEPROM).
+     */
+    template <typename T,
+              size_t read_block_size = INTERNAL_FLASH_READ_BLOCK_SIZE,
+              size_t program_block_size = INTERNAL_FLASH_PROGRAM_BLOCK_SIZE,
+              size_t erase_block_size = INTERNAL_FLASH_ERASE_BLOCK_SIZE>
+    class eeprom_log
+    {
+    private:
+        /**
+         * @brief Record aligned to program_block_size.
+         * @remark program_block_size may be smaller than 4, so a max is needed.
+         */
+        struct alignas(std::max<size_t>(4, program_block_size)) slot_t
+            : public eeprom_record<T>
+        {
+            using eeprom_record<T>::eeprom_record;
+
+            /**
+             * @brief Check if the slot can be programmed without erasing.
+             */
+            bool erased() const
+            {
+                auto bytes = reinterpret_cast<const uint8_t*>(this);
+                for (size_t i = 0; i < sizeof(slot_t); ++i)
+                    if (bytes[i] != 0xFF)
+                        return false;
+                return true;
+            }
+        };
+        static_assert(std::is_trivial<T>::value, "Type T must be trivial.");
+
+    public:
+        /**
+         * @brief Number of writes between two erases.
+         */
+        static constexpr size_t n_slot = erase_block_size / sizeof(slot_t);
+        static_assert(n_slot >= 2, "Type T is too large for append-only mode.");
+
+    private:
+        alignas(std::max<size_t>(4, erase_block_size)) slot_t _slots[n_slot];
+
+    private:
+        /**
+         * @brief Check if the data is stored in EEPROM.
+         */
+        void _check_address() const
+        {
+            assert(IS_OBJECT_IN_INTERNAL_EEPROM(_slots, erase_block_size));
+        }
+        /**
+         * @brief Get the slots for reading.
+         * @see eeprom_read_barrier()
+         */
+        const slot_t* _get_slots() const
+        {
+            return eeprom_read_barrier(_slots);
+        }
+        /**
+         * @brief Index of the first free slot. n_slot if the block is full.
+         */
+        size_t _first_free() const
+        {
+            const slot_t* slots = _get_slots();
+            size_t lo = 0;
+            size_t hi = n_slot;
+            while (lo < hi)
+            {
+                size_t mid = (lo + hi) / 2;
+                if (slots[mid].erased())
+                    hi = mid;
+                else
+                    lo = mid + 1;
+            }
+            return lo;
+        }
+        /**
+         * @brief The latest valid slot, or the first slot if none is valid.
+         */
+        const slot_t& _latest() const
+        {
+            const slot_t* slots = _get_slots();
+            for (size_t i = _first_free(); i; --i)
+                if (slots[i - 1].valid())
+                    return slots[i - 1];
+            return slots[0];
+        }
+
+    public:
+        /**
+         * @brief Default constructor does not make the data valid.
+         * @see valid()
+         */
+        constexpr eeprom_log() : _slots{}
+        {
+        }
+        /**
+         * @brief Initialize the data with the given value.
+         * This constructor makes the data valid.
+         * @see valid()
+         */
+        constexpr eeprom_log(const T& initial_value) : _slots{}
+        {
+            _slots[0] = slot_t{initial_value};
+        }
+
+    public:
+        /**
+         * @brief Get the value of the data.
+         *
+         * @return const T& Value of the data. Note that it is unwriteable.
+         */
+        const T& value() const
+        {
+            _check_address();
+            return _latest().value;
+        }
+        /**
+         * @brief Get the value of the data.
+         *
+         * @return const T& Value of the data. Note that it is unwriteable.
+         */
+        operator const T&() const
+        {
+            return value();
+        }
+
+    public:
+        /**
+         * @brief Check if the data is valid.
+         * The data is valid if you have written to EEPROM,
+         * or the converting constructor is used.
+         */
+        bool valid() const
+        {
+            return _latest().valid();
+        }
+        /**
+         * @brief Write the data to the next free slot. The erase block is
+         * erased only if it is full.
+         */
+        void write(const T& value) const
+        {
+            _check_address();
+            eeprom_device device;
+            // Taken before the erase, so sequence numbers keep increasing.
+            uint32_t sequence = 1;
+            if (const slot_t& latest = _latest(); latest.valid())
+                sequence = latest.next_sequence();
+            size_t index = _first_free();
+            if (index == n_slot)
+            {
+                // sizeof(_slots) may not be a whole block.
+                device.erase(reinterpret_cast<mbed::bd_addr_t>(
+                                 VIRTUAL_ADDRESS_TO_PHYCICAL_ADDRESS(_slots)),
+                             erase_block_size);
+                index = 0;
+            }
+            auto slot = slot_t{sequence, value};
+            device.program(&slot,
+                           reinterpret_cast<mbed::bd_addr_t>(
+                               VIRTUAL_ADDRESS_TO_PHYCICAL_ADDRESS(
+                                   &_slots[index])),
+                           sizeof(slot));
+        }
+        /**
+         * @brief Write the data to the next free slot.
+         * @see write()
+         */
+        const eeprom_log& operator=(const T& value) const
+        {
+            write(value);
+            return *this;
+        }
+    };
+} // namespace modules
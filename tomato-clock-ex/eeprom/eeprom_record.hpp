@@ -0,0 +1,167 @@
+/**
+ * @file eeprom_record.hpp
+ * @author UnnamedOrange
+ * @brief CRC-protected records stored in internal EEPROM.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * @brief Whether the CRC of an initial value can be computed at compile time.
+ */
+#ifndef EEPROM_CONSTEXPR_CRC
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_bit_cast)
+#define EEPROM_CONSTEXPR_CRC 1
+#endif
+#endif
+#endif // EEPROM_CONSTEXPR_CRC
+
+namespace modules
+{
+    namespace detail
+    {
+        constexpr std::array<uint32_t, 256> make_crc32_table()
+        {
+            std::array<uint32_t, 256> ret{};
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t crc = i;
+                for (int bit = 0; bit < 8; ++bit)
+                    crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+                ret[i] = crc;
+            }
+            return ret;
+        }
+        inline constexpr auto crc32_table = make_crc32_table();
+
+        /**
+         * @brief Continue a CRC-32 kept inverted, as eeprom_crc32() does
+         * inside.
+         */
+        template <size_t size>
+        constexpr uint32_t crc32_update(uint32_t crc,
+                                        const std::array<uint8_t, size>& bytes)
+        {
+            for (uint8_t byte : bytes)
+                crc = crc32_table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+            return crc;
+        }
+    } // namespace detail
+
+    /**
+     * @brief CRC-32 (IEEE 802.3, as used by zlib), one table lookup per byte.
+     * @remark The CRC unit of STM32F4 uses a different bit order and only
+     * takes whole words, so it is not used.
+     *
+     * @param crc Result of the previous call to continue a checksum.
+     */
+    inline uint32_t eeprom_crc32(const void* data, size_t size,
+                                 uint32_t crc = 0)
+    {
+        auto bytes = static_cast<const uint8_t*>(data);
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+            crc = detail::crc32_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    /**
+     * @brief A value with a sequence number and a CRC-32 of both.
+     *
+     * @remark The sequence number is programmed first and the CRC last, so a
+     * write interrupted at any point, or a bit flipped inside the value, fails
+     * the check. valid() reads the record once.
+     * @remark The CRC covers the bytes of sequence and value only, not the
+     * padding of the record.
+     * @remark The initial value has sequence number 0 and its CRC is computed
+     * at compile time, which needs __builtin_bit_cast (GCC 11 or Clang). The
+     * bytes of T must then be fully defined, so a T with padding fails to
+     * compile; name the padding as members. Older compilers mark the initial
+     * value with a fixed word instead, so it is not checked. Written records
+     * start from sequence number 1.
+     *
+     * @tparam T Type of data. It must be trivial.
+     */
+    template <typename T>
+    struct eeprom_record
+    {
+        static_assert(std::is_trivial<T>::value, "Type T must be trivial.");
+#if !EEPROM_CONSTEXPR_CRC
+        static constexpr uint32_t initial_marker = 0x5EED5EED;
+#endif
+
+        uint32_t sequence;
+        T value;
+        uint32_t crc;
+
+    private:
+        static constexpr uint32_t _initial_crc(const T& initial_value)
+        {
+#if EEPROM_CONSTEXPR_CRC
+            uint32_t crc = detail::crc32_update(
+                ~uint32_t{}, std::array<uint8_t, sizeof(uint32_t)>{});
+            return ~detail::crc32_update(
+                crc, __builtin_bit_cast(std::array<uint8_t, sizeof(T)>,
+                                        initial_value));
+#else
+            (void)initial_value;
+            return initial_marker;
+#endif
+        }
+
+    public:
+        /**
+         * @brief An invalid record.
+         */
+        constexpr eeprom_record() : sequence{}, value{}, crc{}
+        {
+        }
+        /**
+         * @brief The initial value, which is valid.
+         */
+        constexpr eeprom_record(const T& initial_value)
+            : sequence{}, value{initial_value},
+              crc{_initial_crc(initial_value)}
+        {
+        }
+        /**
+         * @brief A record to be written.
+         */
+        eeprom_record(uint32_t sequence, const T& value)
+            : sequence{sequence}, value{value}, crc{}
+        {
+            crc = compute_crc();
+        }
+
+        uint32_t compute_crc() const
+        {
+            return eeprom_crc32(&value, sizeof(value),
+                                eeprom_crc32(&sequence, sizeof(sequence)));
+        }
+        bool valid() const
+        {
+#if !EEPROM_CONSTEXPR_CRC
+            if (!sequence)
+                return crc == initial_marker;
+#endif
+            return crc == compute_crc();
+        }
+        /**
+         * @brief Sequence number of the record written after this one.
+         * 0 is skipped when the number wraps.
+         */
+        uint32_t next_sequence() const
+        {
+            return sequence + 1 ? sequence + 1 : 1;
+        }
+    };
+} // namespace modules
@@ -0,0 +1,403 @@
+/**
+ * @file eeprom_sim.hpp
+ * @author UnnamedOrange
+ * @brief Simulated internal flash of STM32F401RE, so that the eeprom library
+ * can be built and exercised on a host.
+ * @remark Define EEPROM_SIMULATOR to 1 (e.g. `g++ -std=c++17
+ * -DEEPROM_SIMULATOR=1 ...`), and eeprom.hpp includes this header instead of
+ * mbed.h and FlashIAPBlockDevice.h. eeprom_worker.hpp needs RTOS threads and
+ * is not supported.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace mbed
+{
+    using bd_addr_t = uint64_t;
+    using bd_size_t = uint64_t;
+} // namespace mbed
+
+enum bd_error
+{
+    BD_ERROR_OK = 0,
+    BD_ERROR_DEVICE_ERROR = -4001,
+};
+
+namespace modules
+{
+    /**
+     * @brief Flash of STM32F401RE in RAM, with the behaviour the eeprom
+     * library relies on.
+     *
+     * @remark Erase works on whole sectors of the real, non-uniform map (4 x
+     * 16 KB, 64 KB, 3 x 128 KB). Programming may only clear bits, and by
+     * default only erased bytes may be programmed. Violations fail with
+     * BD_ERROR_DEVICE_ERROR and are counted.
+     * @remark Every operation advances a simulated clock by the typical time
+     * of the datasheet. us_ticker_read() and rtos::Kernel::Clock follow this
+     * clock, so stalls and commit policies can be measured.
+     * @remark cut_power_at() injects a reset: the operation in progress is
+     * left half done and flash_simulator::power_cut is thrown. The flash
+     * keeps its content, so constructing the RAM objects again simulates
+     * the next boot.
+     */
+    class flash_simulator
+    {
+    public:
+        static constexpr size_t size = 0x80000;
+        static constexpr size_t n_sector = 8;
+        static constexpr std::array<uint32_t, n_sector> sector_sizes{
+            0x4000, 0x4000, 0x4000, 0x4000, 0x10000, 0x20000, 0x20000, 0x20000,
+        };
+        // Typical times with 32-bit parallelism, DS10086.
+        static constexpr uint32_t erase_16k_us = 250000;
+        static constexpr uint32_t erase_64k_us = 550000;
+        static constexpr uint32_t erase_128k_us = 1000000;
+        static constexpr uint32_t program_word_us = 16;
+
+        /**
+         * @brief Thrown when the injected power cut happens.
+         */
+        struct power_cut
+        {
+        };
+        struct stats_t
+        {
+            std::array<uint32_t, n_sector> n_erase; // Per sector.
+            uint32_t n_program;
+            uint64_t n_programmed_byte;
+            uint32_t n_violation; // Operations rejected as invalid.
+        };
+
+    private:
+        alignas(0x4000) std::array<uint8_t, size> _memory;
+        stats_t _stats;
+        uint64_t _now_us;
+        uint64_t _cut_at_us;
+        bool _strict = true;
+        uint32_t _random = 2463534242u;
+
+        uint8_t _next_random()
+        {
+            _random ^= _random << 13;
+            _random ^= _random >> 17;
+            _random ^= _random << 5;
+            return static_cast<uint8_t>(_random);
+        }
+        /**
+         * @brief Advance the clock by duration_us. If the power is cut in
+         * between, return the fraction of the operation done, in [0, 1).
+         */
+        double _spend(uint64_t duration_us)
+        {
+            if (_now_us + duration_us < _cut_at_us)
+            {
+                _now_us += duration_us;
+                return 1;
+            }
+            double done = double(_cut_at_us - std::min(_now_us, _cut_at_us)) /
+                          double(duration_us);
+            _now_us = std::max(_now_us, _cut_at_us);
+            _cut_at_us = UINT64_MAX;
+            return done;
+        }
+        static uint32_t _erase_us(uint32_t sector_size)
+        {
+            if (sector_size <= 0x4000)
+                return erase_16k_us;
+            if (sector_size <= 0x10000)
+                return erase_64k_us;
+            return erase_128k_us;
+        }
+
+    public:
+        flash_simulator()
+        {
+            reset();
+        }
+        flash_simulator(const flash_simulator&) = delete;
+        flash_simulator& operator=(const flash_simulator&) = delete;
+
+        /**
+         * @brief The flash used by eeprom_device.
+         */
+        static flash_simulator& instance()
+        {
+            static flash_simulator simulator;
+            return simulator;
+        }
+        /**
+         * @brief Erase everything and clear the statistics and the clock.
+         */
+        void reset()
+        {
+            _memory.fill(0xFF);
+            _stats = {};
+            _now_us = 0;
+            _cut_at_us = UINT64_MAX;
+        }
+
+    public:
+        uint8_t* data()
+        {
+            return _memory.data();
+        }
+        /**
+         * @brief Construct an object in the flash, like the linker placing a
+         * constexpr global in the image.
+         *
+         * @param offset Offset from the start of the flash. It must be
+         * aligned for T. EEPROM objects must be within the region given by
+         * INTERNAL_EEPROM_OFFSET and INTERNAL_EEPROM_SIZE.
+         */
+        template <typename T, typename... args_t>
+        const T& place(size_t offset, args_t&&... args)
+        {
+            assert(offset % alignof(T) == 0 && offset + sizeof(T) <= size);
+            return *new (&_memory[offset]) T(std::forward<args_t>(args)...);
+        }
+        /**
+         * @param strict Whether only erased bytes may be programmed. If not,
+         * programming a byte only needs to clear bits.
+         */
+        void set_strict(bool strict)
+        {
+            _strict = strict;
+        }
+
+    public:
+        static size_t sector_of(uint64_t address)
+        {
+            size_t sector = 0;
+            for (uint64_t start = sector_sizes[0];
+                 sector + 1 < n_sector && address >= start;
+                 start += sector_sizes[++sector])
+                ;
+            return sector;
+        }
+        static uint64_t sector_start(size_t sector)
+        {
+            uint64_t start = 0;
+            for (size_t i = 0; i < sector; ++i)
+                start += sector_sizes[i];
+            return start;
+        }
+
+        int erase(uint64_t address, uint64_t length)
+        {
+            if (address + length > size)
+            {
+                _stats.n_violation++;
+                return BD_ERROR_DEVICE_ERROR;
+            }
+            // Check the whole range first, so nothing is erased on error.
+            for (uint64_t a = address; a < address + length;)
+            {
+                size_t sector = sector_of(a);
+                if (a != sector_start(sector) ||
+                    address + length - a < sector_sizes[sector])
+                {
+                    _stats.n_violation++;
+                    return BD_ERROR_DEVICE_ERROR;
+                }
+                a += sector_sizes[sector];
+            }
+            while (length)
+            {
+                size_t sector = sector_of(address);
+                uint32_t sector_size = sector_sizes[sector];
+                _stats.n_erase[sector]++;
+                if (_spend(_erase_us(sector_size)) < 1)
+                {
+                    // Cells of an interrupted erase are in no known state.
+                    for (uint32_t i = 0; i < sector_size; ++i)
+                        _memory[address + i] |= _next_random();
+                    throw power_cut{};
+                }
+                std::fill_n(&_memory[address], sector_size, 0xFF);
+                address += sector_size;
+                length -= sector_size;
+            }
+            return BD_ERROR_OK;
+        }
+        int program(const void* buffer, uint64_t address, uint64_t length)
+        {
+            auto bytes = static_cast<const uint8_t*>(buffer);
+            if (address + length > size)
+            {
+                _stats.n_violation++;
+                return BD_ERROR_DEVICE_ERROR;
+            }
+            for (uint64_t i = 0; i < length; ++i)
+            {
+                uint8_t old = _memory[address + i];
+                if ((_strict && old != 0xFF) || (old & bytes[i]) != bytes[i])
+                {
+                    _stats.n_violation++;
+                    return BD_ERROR_DEVICE_ERROR;
+                }
+            }
+            _stats.n_program++;
+            double done = _spend((length + 3) / 4 * program_word_us);
+            uint64_t n_done = static_cast<uint64_t>(done * length);
+            for (uint64_t i = 0; i < n_done; ++i)
+                _memory[address + i] = bytes[i];
+            _stats.n_programmed_byte += n_done;
+            if (n_done < length)
+            {
+                // The byte being programmed loses only some of its bits.
+                _memory[address + n_done] &= bytes[n_done] | _next_random();
+                throw power_cut{};
+            }
+            return BD_ERROR_OK;
+        }
+        int read(void* buffer, uint64_t address, uint64_t length) const
+        {
+            if (address + length > size)
+                return BD_ERROR_DEVICE_ERROR;
+            std::memcpy(buffer, &_memory[address], length);
+            return BD_ERROR_OK;
+        }
+
+    public:
+        uint64_t now_us() const
+        {
+            return _now_us;
+        }
+        /**
+         * @brief Let time pass without flash operations, e.g. between UI
+         * events.
+         */
+        void advance_us(uint64_t duration_us)
+        {
+            _now_us += duration_us;
+        }
+        /**
+         * @brief Cut the power when the clock reaches time_us during an erase
+         * or a program. Nothing happens if no operation is in progress then.
+         */
+        void cut_power_at(uint64_t time_us)
+        {
+            _cut_at_us = time_us;
+        }
+        void cancel_power_cut()
+        {
+            _cut_at_us = UINT64_MAX;
+        }
+        const stats_t& stats() const
+        {
+            return _stats;
+        }
+    };
+} // namespace modules
+
+#ifndef INTERNAL_FLASH_BASE_ADDRESS
+#define INTERNAL_FLASH_BASE_ADDRESS                                            \
+    ((void*)::modules::flash_simulator::instance().data())
+#endif
+
+inline uint32_t us_ticker_read()
+{
+    return static_cast<uint32_t>(
+        ::modules::flash_simulator::instance().now_us());
+}
+inline void core_util_critical_section_enter()
+{
+}
+inline void core_util_critical_section_exit()
+{
+}
+
+namespace rtos
+{
+    namespace Kernel
+    {
+        /**
+         * @brief Follows the clock of the simulator.
+         */
+        struct Clock
+        {
+            using duration = std::chrono::milliseconds;
+            using rep = duration::rep;
+            using period = duration::period;
+            using time_point = std::chrono::time_point<Clock>;
+            static constexpr bool is_steady = true;
+            static time_point now()
+            {
+                return time_point(duration(
+                    ::modules::flash_simulator::instance().now_us() / 1000));
+            }
+        };
+    } // namespace Kernel
+} // namespace rtos
+
+using namespace std::chrono_literals;
+
+/**
+ * @brief Stand-in of mbed's FlashIAPBlockDevice over flash_simulator.
+ * Addresses are relative to the start of the flash.
+ */
+class FlashIAPBlockDevice
+{
+public:
+    FlashIAPBlockDevice(uint32_t, uint32_t)
+    {
+    }
+    int init()
+    {
+        return BD_ERROR_OK;
+    }
+    int deinit()
+    {
+        return BD_ERROR_OK;
+    }
+    int read(void* buffer, mbed::bd_addr_t address, mbed::bd_size_t size)
+    {
+        return _simulator().read(buffer, address, size);
+    }
+    int program(const void* buffer, mbed::bd_addr_t address,
+                mbed::bd_size_t size)
+    {
+        return _simulator().program(buffer, address, size);
+    }
+    int erase(mbed::bd_addr_t address, mbed::bd_size_t size)
+    {
+        return _simulator().erase(address, size);
+    }
+    mbed::bd_size_t get_read_size() const
+    {
+        return 1;
+    }
+    mbed::bd_size_t get_program_size() const
+    {
+        return 1;
+    }
+    mbed::bd_size_t get_erase_size() const
+    {
+        return ::modules::flash_simulator::sector_sizes[0];
+    }
+    mbed::bd_size_t get_erase_size(mbed::bd_addr_t address) const
+    {
+        return ::modules::flash_simulator::sector_sizes
+            [::modules::flash_simulator::sector_of(address)];
+    }
+
+private:
+    static ::modules::flash_simulator& _simulator()
+    {
+        return ::modules::flash_simulator::instance();
+    }
+};
@@ -0,0 +1,171 @@
+/**
+ * @file eeprom_worker.hpp
+ * @author UnnamedOrange
+ * @brief Write to EEPROM on a background thread inside idle windows.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <new>
+
+#include "eeprom.hpp"
+
+namespace modules
+{
+    /**
+     * @brief Perform writes of EEPROM stores on a low-priority thread, so the
+     * caller returns at once and is told by a callback when the write is
+     * done.
+     *
+     * @remark The internal flash of STM32F401 has one bank. While it is
+     * erased or programmed, nothing can be fetched from the flash, whatever
+     * thread the code is on. A background thread alone only moves the stall,
+     * so the worker starts a write only when the window callback returns
+     * true, e.g. right after a frame is drawn, or when no I2C transfer is
+     * expected. Use eeprom_log<T> or eeprom_kv to keep each stall at a
+     * program instead of a 16 KB erase.
+     * @remark Stall durations are reported by stats() and, per erase and
+     * program, by eeprom_device::stats().
+     *
+     * @tparam max_value_size Size of the largest value that can be queued.
+     * @tparam queue_size Number of writes that can be queued.
+     */
+    template <size_t max_value_size = 64, size_t queue_size = 4>
+    class eeprom_worker
+    {
+    public:
+        using done_t = mbed::Callback<void()>;
+        using window_t = mbed::Callback<bool()>;
+
+        struct stats_t
+        {
+            uint32_t n_write;
+            uint32_t n_rejected;  // The queue was full.
+            uint32_t max_wait_us; // From write_async() to the start.
+            uint32_t max_stall_us;
+            uint32_t total_stall_us;
+        };
+
+    private:
+        static constexpr auto window_poll_interval = 10ms;
+
+        struct job_t
+        {
+            void (*write)(const void* store, const void* value);
+            const void* store;
+            alignas(8) uint8_t value[max_value_size];
+            done_t done;
+            uint32_t queued_us;
+        };
+        rtos::Mail<job_t, queue_size> _mail;
+        rtos::Thread _thread{osPriorityLow, 1024};
+        window_t _window;
+        std::atomic<uint32_t> _n_pending{}; // Queued or running.
+        stats_t _stats{};
+
+    public:
+        /**
+         * @param window Called on the worker thread before each write.
+         * Return true if a stall is acceptable now. If it is empty, writes
+         * start at once.
+         */
+        explicit eeprom_worker(window_t window = nullptr) : _window{window}
+        {
+            _thread.start(mbed::callback(this, &eeprom_worker::_run));
+        }
+
+    public:
+        /**
+         * @brief Queue a write of store. Can be called in an ISR.
+         *
+         * @param store eeprom<T>, eeprom_log<T> or any type with write(). It
+         * must outlive the write.
+         * @param value Copied into the queue.
+         * @param done Called on the worker thread after the write.
+         * @return bool false if the queue is full and nothing is queued.
+         */
+        template <typename store_t, typename T>
+        bool write_async(const store_t& store, const T& value,
+                         done_t done = nullptr)
+        {
+            static_assert(std::is_trivial<T>::value,
+                          "Type T must be trivial.");
+            static_assert(sizeof(T) <= max_value_size,
+                          "Type T is larger than max_value_size.");
+            job_t* memory = _mail.try_alloc();
+            if (!memory)
+            {
+                core_util_critical_section_enter();
+                _stats.n_rejected++;
+                core_util_critical_section_exit();
+                return false;
+            }
+            // The pool does not construct done_t.
+            job_t* job = new (memory) job_t;
+            job->write = [](const void* store, const void* value) {
+                T copy;
+                std::memcpy(&copy, value, sizeof(T));
+                static_cast<const store_t*>(store)->write(copy);
+            };
+            job->store = &store;
+            std::memcpy(job->value, &value, sizeof(T));
+            job->done = done;
+            job->queued_us = us_ticker_read();
+            _n_pending++;
+            _mail.put(job);
+            return true;
+        }
+        /**
+         * @brief Whether no write is queued or running.
+         */
+        bool idle() const
+        {
+            return !_n_pending;
+        }
+        stats_t stats() const
+        {
+            core_util_critical_section_enter();
+            stats_t ret = _stats;
+            core_util_critical_section_exit();
+            return ret;
+        }
+
+    private:
+        void _run()
+        {
+            while (true)
+            {
+                job_t* job =
+                    _mail.try_get_for(rtos::Kernel::wait_for_u32_forever);
+                if (!job)
+                    continue;
+                while (_window && !_window())
+                    rtos::ThisThread::sleep_for(window_poll_interval);
+
+                uint32_t start = us_ticker_read();
+                job->write(job->store, job->value);
+                uint32_t end = us_ticker_read();
+                core_util_critical_section_enter();
+                _stats.n_write++;
+                _stats.max_wait_us =
+                    std::max(_stats.max_wait_us, start - job->queued_us);
+                _stats.max_stall_us =
+                    std::max(_stats.max_stall_us, end - start);
+                _stats.total_stall_us += end - start;
+                core_util_critical_section_exit();
+
+                if (job->done)
+                    job->done();
+                job->~job_t();
+                _mail.free(job);
+                _n_pending--;
+            }
+        }
+    };
+} // namespace modules
@@ -0,0 +1,110 @@
+/**
+ * @file eeprom_history_test.cpp
+ * @author UnnamedOrange
+ * @brief Check that eeprom_session_history reads back what it stores, and its
+ * statistics, on the flash simulator.
+ * @remark Build in tomato-clock-ex with
+ * `g++ -std=c++17 -O2 -DEEPROM_SIMULATOR=1 -I . -o eeprom_history_test
+ * tools/eeprom_history_test.cpp`. It exits with 1 if a check fails.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "eeprom/eeprom_history.hpp"
+
+using namespace modules;
+
+namespace
+{
+    constexpr size_t offset = INTERNAL_EEPROM_OFFSET; // Sectors 1 and 2.
+    int n_failure;
+
+    void expect(bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            std::printf("  FAILED: %s\n", what);
+            n_failure++;
+        }
+    }
+
+    /**
+     * @brief Append sessions with random gaps, including gaps that need an
+     * anchor, until the ring has wrapped, and compare with a reference.
+     */
+    void round_trip()
+    {
+        auto& flash = flash_simulator::instance();
+        flash.reset();
+        auto& area = flash.place<eeprom_history_area>(offset);
+        std::mt19937 rng(1);
+        std::vector<eeprom_session> sessions;
+        time_t time = 1760000000;
+        {
+            eeprom_session_history history(area);
+            for (int i = 0; i < 10000; i++)
+            {
+                eeprom_session session{
+                    time, static_cast<uint32_t>(1500 + rng() % 60),
+                    eeprom_session::kind_t(i % 2),
+                    eeprom_session::end_t(rng() % 3)};
+                history.append(session);
+                sessions.push_back(session);
+                time += session.duration +
+                        (rng() % 20 ? rng() % 600 : 86400 * (rng() % 3 + 1));
+            }
+        }
+
+        eeprom_session_history history(area);
+        std::printf("  %zu appended, %u kept\n", sessions.size(),
+                    history.size());
+        expect(history.size() && history.size() < sessions.size(),
+               "the ring wraps");
+        size_t first = sessions.size() - history.size();
+        size_t i = first;
+        bool same = true;
+        history.for_each([&](const eeprom_session& session) {
+            const eeprom_session& expected = sessions[i++];
+            same = same && session.start == expected.start / 60 * 60 &&
+                   session.duration == expected.duration &&
+                   session.kind == expected.kind &&
+                   session.end == expected.end;
+        });
+        expect(same && i == sessions.size(), "for_each() reads back");
+
+        int32_t today = eeprom_session_history::day_of(sessions.back().start);
+        eeprom_session_history::day_stats_t expected{today};
+        for (size_t j = first; j < sessions.size(); j++)
+        {
+            const eeprom_session& session = sessions[j];
+            int32_t day = eeprom_session_history::day_of(session.start);
+            if (day <= today - int32_t(eeprom_session_history::n_day) ||
+                session.kind != eeprom_session::kind_t::work)
+                continue;
+            expected.n_work++;
+            expected.n_early += session.end == eeprom_session::end_t::early;
+            expected.n_late += session.end == eeprom_session::end_t::late;
+            expected.work_seconds += session.duration;
+        }
+        auto week = history.week(today);
+        expect(week.n_work == expected.n_work &&
+                   week.n_early == expected.n_early &&
+                   week.n_late == expected.n_late &&
+                   week.work_seconds == expected.work_seconds,
+               "week() matches the sessions");
+        expect(!flash.stats().n_violation, "no invalid flash operation");
+    }
+} // namespace
+
+int main()
+{
+    std::printf("Round trip:\n");
+    round_trip();
+    std::printf("%d failures.\n", n_failure);
+    return n_failure ? 1 : 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file eeprom_kv_test.cpp
+ * @author UnnamedOrange
+ * @brief Check eeprom_kv on the flash simulator, with keys that nearly fill an
+ * erase block and with power cuts during compaction.
+ * @remark Build in tomato-clock-ex with
+ * `g++ -std=c++17 -O2 -DEEPROM_SIMULATOR=1 -I . -o eeprom_kv_test
+ * tools/eeprom_kv_test.cpp`. It exits with 1 if a check fails.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include <cstdio>
+#include <random>
+
+#include "eeprom/eeprom_kv.hpp"
+
+using namespace modules;
+
+namespace
+{
+    constexpr size_t offset = INTERNAL_EEPROM_OFFSET; // Sectors 1 and 2.
+    int n_failure;
+
+    void expect(bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            std::printf("  FAILED: %s\n", what);
+            n_failure++;
+        }
+    }
+
+    // Two records of this size fill most of an erase block, so the block
+    // cannot hold a third one.
+    struct big_t
+    {
+        uint32_t v;
+        uint8_t padding[8096];
+    };
+    using big1_key = eeprom_key<1, big_t>;
+    using big2_key = eeprom_key<2, big_t>;
+
+    /**
+     * @brief Rewrite the keys of a nearly full store, so that every write
+     * compacts.
+     */
+    void nearly_full()
+    {
+        using kv_t = eeprom_kv<big1_key, big2_key>;
+        auto& flash = flash_simulator::instance();
+        flash.reset();
+        auto& area = flash.place<eeprom_kv_area>(offset);
+        kv_t kv(area);
+        bool ok = true;
+        for (uint32_t i = 1; i <= 100; i++)
+        {
+            kv.set<big1_key>({i, {}});
+            kv.set<big2_key>({i + 1000, {}});
+            ok = ok && kv.get<big1_key>()->v == i &&
+                 kv.get<big2_key>()->v == i + 1000;
+        }
+        kv_t reloaded(area);
+        std::printf("  %u erases of sectors 1 and 2\n",
+                    flash.stats().n_erase[1] + flash.stats().n_erase[2]);
+        expect(ok, "every write reads back");
+        expect(reloaded.get<big1_key>() && reloaded.get<big1_key>()->v == 100 &&
+                   reloaded.get<big2_key>() &&
+                   reloaded.get<big2_key>()->v == 1100,
+               "the latest values reload");
+        expect(!flash.stats().n_violation, "no invalid flash operation");
+    }
+
+    /**
+     * @brief Cut the power at points of writes that compact, and check that
+     * each key holds its old or its new value.
+     */
+    void power_cuts()
+    {
+        using kv_t = eeprom_kv<big1_key, big2_key>;
+        auto& flash = flash_simulator::instance();
+        flash.reset();
+        auto& area = flash.place<eeprom_kv_area>(offset);
+        {
+            kv_t kv(area);
+            kv.set<big1_key>({0, {}});
+            kv.set<big2_key>({0, {}});
+        }
+        std::mt19937 rng(1);
+        int n_cut = 0;
+        bool ok = true;
+        for (int trial = 0; trial < 2000; trial++)
+        {
+            kv_t kv(area);
+            uint32_t before1 = kv.get<big1_key>()->v;
+            uint32_t before2 = kv.get<big2_key>()->v;
+            bool first = rng() % 2;
+            flash.cut_power_at(flash.now_us() + rng() % 400000);
+            try
+            {
+                if (first)
+                    kv.set<big1_key>({before1 + 1, {}});
+                else
+                    kv.set<big2_key>({before2 + 1, {}});
+            }
+            catch (flash_simulator::power_cut&)
+            {
+                n_cut++;
+            }
+            flash.cancel_power_cut();
+            kv_t after(area);
+            auto value1 = after.get<big1_key>();
+            auto value2 = after.get<big2_key>();
+            ok = ok && value1 && value2;
+            if (!ok)
+                break;
+            uint32_t new1 = first ? before1 + 1 : before1;
+            uint32_t new2 = first ? before2 : before2 + 1;
+            ok = (value1->v == before1 || value1->v == new1) &&
+                 (value2->v == before2 || value2->v == new2);
+        }
+        std::printf("  %d power cuts in 2000 writes\n", n_cut);
+        expect(n_cut, "some writes are cut");
+        expect(ok, "a cut write keeps the old or the new value");
+    }
+} // namespace
+
+int main()
+{
+    std::printf("Keys that nearly fill a block:\n");
+    nearly_full();
+    std::printf("Power cuts during compaction:\n");
+    power_cuts();
+    std::printf("%d failures.\n", n_failure);
+    return n_failure ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file eeprom_shared_test.cpp
+ * @author UnnamedOrange
+ * @brief Check eeprom_kv and eeprom_session_history sharing the three erase
+ * blocks of .eeprom_arena on the flash simulator.
+ * @remark Build in tomato-clock-ex with
+ * `g++ -std=c++17 -O2 -DEEPROM_SIMULATOR=1 -I . -o eeprom_shared_test
+ * tools/eeprom_shared_test.cpp`. It exits with 1 if a check fails.
+ *
+ * @copyright Copyright (c) UnnamedOrange. Licensed under the MIT License.
+ * See the LICENSE file in the repository root for full license text.
+ */
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "eeprom/eeprom_history.hpp"
+#include "eeprom/eeprom_kv.hpp"
+
+using namespace modules;
+
+namespace
+{
+    using counter_key = eeprom_key<1, uint32_t>;
+    struct blob_t
+    {
+        uint32_t index;
+        uint8_t padding[60];
+    };
+    using blob_key = eeprom_key<2, blob_t>;
+    using kv_t = eeprom_kv<counter_key, blob_key>;
+
+    static_assert(sizeof(eeprom_shared_area) == INTERNAL_EEPROM_SIZE,
+                  "The shared area fills .eeprom_arena.");
+    constexpr size_t offset = INTERNAL_EEPROM_OFFSET; // Sectors 1 to 3.
+    int n_failure;
+
+    void expect(bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            std::printf("  FAILED: %s\n", what);
+            n_failure++;
+        }
+    }
+
+    /**
+     * @brief Visit the history, and check that it is in order and that its
+     * size is right.
+     *
+     * @return std::vector<time_t> Starts of the sessions.
+     */
+    std::vector<time_t> starts_of(const eeprom_session_history& history)
+    {
+        std::vector<time_t> ret;
+        history.for_each([&](const eeprom_session& session) {
+            ret.push_back(session.start);
+        });
+        bool sorted = true;
+        for (size_t i = 1; i < ret.size(); i++)
+            sorted = sorted && ret[i - 1] < ret[i];
+        expect(sorted, "sessions are in order");
+        expect(ret.size() == history.size(), "size() counts the sessions");
+        return ret;
+    }
+
+    /**
+     * @brief Write both stores in turn until each has taken a new block many
+     * times, and check the data after each write and after a reload.
+     */
+    void interleaved()
+    {
+        auto& flash = flash_simulator::instance();
+        flash.reset();
+        auto& area = flash.place<eeprom_shared_area>(offset);
+        kv_t kv(area);
+        eeprom_session_history history(area);
+        std::mt19937 rng(1);
+        time_t time = 1760000000;
+        uint32_t counter = 0;
+        size_t n_appended = 0;
+        bool ok = true;
+        for (int i = 0; i < 40000; i++)
+        {
+            if (rng() % 2)
+            {
+                kv.set<counter_key>(++counter);
+                kv.set<blob_key>({counter, {}});
+            }
+            else
+            {
+                history.append({time, 1500, eeprom_session::kind_t::work,
+                                eeprom_session::end_t::on_time});
+                time += 1800;
+                n_appended++;
+            }
+            ok = ok && kv.value_or<counter_key>(0) == counter &&
+                 (!counter || kv.get<blob_key>()->index == counter) &&
+                 (history.size() || !n_appended) &&
+                 history.size() <= n_appended;
+        }
+        expect(ok, "every write reads back");
+        std::printf("  erases of sectors 1 to 3: %u %u %u, %u sessions kept\n",
+                    flash.stats().n_erase[1], flash.stats().n_erase[2],
+                    flash.stats().n_erase[3], history.size());
+
+        std::vector<time_t> starts = starts_of(history);
+        expect(!starts.empty() && starts.back() == (time - 1800) / 60 * 60,
+               "the latest session is kept");
+        kv_t kv_reloaded(area);
+        eeprom_session_history history_reloaded(area);
+        expect(kv_reloaded.value_or<counter_key>(0) == counter,
+               "eeprom_kv reloads");
+        expect(starts_of(history_reloaded) == starts,
+               "eeprom_session_history reloads");
+        expect(!flash.stats().n_violation, "no invalid flash operation");
+    }
+
+    /**
+     * @brief Cut the power during writes of both stores, and check that
+     * neither store loses what the other wrote.
+     */
+    void power_cuts()
+    {
+        auto& flash = flash_simulator::instance();
+        flash.reset();
+        auto& area = flash.place<eeprom_shared_area>(offset);
+        std::mt19937 rng(2);
+        time_t time = 1760000000;
+        uint32_t counter = 0;
+        int n_cut = 0;
+        bool ok = true;
+        for (int i = 0; i < 20000; i++)
+        {
+            kv_t kv(area);
+            eeprom_session_history history(area);
+            uint32_t n_session = history.size();
+            bool write_kv = rng() % 2;
+            // Most cuts hit a program, the others an erase.
+            flash.cut_power_at(flash.now_us() +
+                               rng() % (rng() % 8 ? 500 : 500000));
+            try
+            {
+                if (write_kv)
+                    kv.set<blob_key>({counter + 1, {}});
+                else
+                    history.append({time, 1500, eeprom_session::kind_t::rest,
+                                    eeprom_session::end_t::late});
+                flash.cancel_power_cut();
+            }
+            catch (flash_simulator::power_cut&)
+            {
+                flash.cancel_power_cut();
+                n_cut++;
+            }
+
+            kv_t kv_after(area);
+            eeprom_session_history history_after(area);
+            auto blob = kv_after.get<blob_key>();
+            uint32_t after = blob ? blob->index : 0;
+            if (write_kv)
+                ok = ok && (after == counter || after == counter + 1);
+            else
+            {
+                ok = ok && after == counter;
+                time += 1800;
+            }
+            // A new block of either store may take the older block of the
+            // history, but never the active one.
+            ok = ok && (history_after.size() || !n_session);
+            counter = after;
+            starts_of(history_after);
+        }
+        std::printf("  %d power cuts in 20000 writes\n", n_cut);
+        expect(n_cut, "some writes are cut");
+        expect(ok, "a cut write keeps the data of both stores");
+    }
+} // namespace
+
+int main()
+{
+    std::printf("Interleaved writes:\n");
+    interleaved();
+    std::printf("Power cuts:\n");
+    power_cuts();
+    std::printf("%d failures.\n", n_failure);
+    return n_failure ? 1 : 0;
+}